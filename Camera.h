@@ -0,0 +1,16 @@
+#pragma once
+#include "common.h"
+
+//Pinhole camera, the rotation columns are its right, up and forward axes and fov is half the vertical field of view
+//in radians
+//Only describes the view, the image size comes from the render target so one camera can render at any resolution
+struct Camera
+{
+	glm::vec3 position;
+	glm::mat3 rotation;
+	float fov;
+
+	Camera(glm::vec3 position, glm::mat3 rotation, float fov) :
+		position(position), rotation(rotation), fov(fov)
+	{}
+};
@@ -0,0 +1,116 @@
+#include "Denoiser.h"
+
+#define DENOISE_BAND_HEIGHT 16
+
+void DenoiseAtrous(ThreadPool& threadPool, glm::uvec2 size, glm::vec3* pixels, const GBuffer& gBuffer, const DenoiseSettings& settings)
+{
+	const int32_t width = (int32_t)size.x, height = (int32_t)size.y;
+	const size_t count = size.x * size.y;
+
+	//Planar copies so every tap runs over contiguous floats
+	std::vector<float> input[3], output[3];
+	std::vector<float> normalX(count), normalY(count), normalZ(count);
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		input[c].resize(count);
+		output[c].resize(count);
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		input[0][i] = pixels[i].x;
+		input[1][i] = pixels[i].y;
+		input[2][i] = pixels[i].z;
+		normalX[i] = gBuffer.normal[i].x;
+		normalY[i] = gBuffer.normal[i].y;
+		normalZ[i] = gBuffer.normal[i].z;
+	}
+
+	const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+	const float* depth = gBuffer.depth.data();
+	const MaterialId* material = gBuffer.material.data();
+
+	uint32_t bandCount = (size.y + DENOISE_BAND_HEIGHT - 1) / DENOISE_BAND_HEIGHT;
+	for (uint32_t iteration = 0; iteration < settings.iterations; iteration++)
+	{
+		const int32_t step = 1 << iteration;
+		const float colorSigma = settings.colorSigma / (float)step;
+		const float colorScale = 1.0f / (colorSigma * colorSigma);
+
+		threadPool.ParallelFor(bandCount, [&](uint32_t band) {
+			std::vector<float> sumR(width), sumG(width), sumB(width), sumWeight(width);
+
+			int32_t bottom = glm::min((int32_t)(band + 1) * DENOISE_BAND_HEIGHT, height);
+			for (int32_t y = band * DENOISE_BAND_HEIGHT; y < bottom; y++)
+			{
+				std::fill(sumR.begin(), sumR.end(), 0.0f);
+				std::fill(sumG.begin(), sumG.end(), 0.0f);
+				std::fill(sumB.begin(), sumB.end(), 0.0f);
+				std::fill(sumWeight.begin(), sumWeight.end(), 0.0f);
+
+				const size_t row = (size_t)y * width;
+				const float* r = &input[0][row], * g = &input[1][row], * b = &input[2][row];
+				const float* nx = &normalX[row], * ny = &normalY[row], * nz = &normalZ[row];
+				const float* d = &depth[row];
+				const MaterialId* m = &material[row];
+
+				for (int32_t ky = -2; ky <= 2; ky++)
+				{
+					int32_t y2 = y + ky * step;
+					if (y2 < 0 || y2 >= height)
+						continue;
+
+					for (int32_t kx = -2; kx <= 2; kx++)
+					{
+						const int32_t dx = kx * step;
+						const int32_t begin = glm::max(0, -dx), end = glm::min(width, width - dx);
+						const float k = kernel[ky + 2] * kernel[kx + 2];
+						const float depthScale = 1.0f / (settings.depthSigma * (float)(glm::abs(kx) + glm::abs(ky)) * (float)step + 1e-4f);
+
+						//Tap x + dx stays inside row y2 for every x in [begin, end), the row pointers themselves never leave
+						//the buffers
+						const size_t row2 = (size_t)y2 * width;
+						const float* r2 = input[0].data() + row2, * g2 = input[1].data() + row2, * b2 = input[2].data() + row2;
+						const float* nx2 = normalX.data() + row2, * ny2 = normalY.data() + row2, * nz2 = normalZ.data() + row2;
+						const float* d2 = depth + row2;
+						const MaterialId* m2 = material + row2;
+
+						//Inner loop is branch free over contiguous arrays so it vectorizes
+						for (int32_t x = begin; x < end; x++)
+						{
+							const int32_t x2 = x + dx;
+							float cr = r2[x2] - r[x], cg = g2[x2] - g[x], cb = b2[x2] - b[x];
+							float colorWeight = expf(-(cr * cr + cg * cg + cb * cb) * colorScale);
+
+							float normalDot = fmaxf(nx[x] * nx2[x2] + ny[x] * ny2[x2] + nz[x] * nz2[x2], 0.0f);
+							float normalWeight = powf(normalDot, settings.normalPower);
+
+							float depthWeight = expf(-fabsf(d[x] - d2[x2]) / d[x] * depthScale);
+							float materialWeight = m[x] == m2[x2] ? 1.0f : 0.0f;
+
+							float weight = k * colorWeight * normalWeight * depthWeight * materialWeight;
+							sumR[x] += r2[x2] * weight;
+							sumG[x] += g2[x2] * weight;
+							sumB[x] += b2[x2] * weight;
+							sumWeight[x] += weight;
+						}
+					}
+				}
+
+				//The center tap always has a positive weight
+				for (int32_t x = 0; x < width; x++)
+				{
+					float inverseWeight = 1.0f / sumWeight[x];
+					output[0][row + x] = sumR[x] * inverseWeight;
+					output[1][row + x] = sumG[x] * inverseWeight;
+					output[2][row + x] = sumB[x] * inverseWeight;
+				}
+			}
+		});
+
+		for (uint32_t c = 0; c < 3; c++)
+			std::swap(input[c], output[c]);
+	}
+
+	for (size_t i = 0; i < count; i++)
+		pixels[i] = glm::vec3(input[0][i], input[1][i], input[2][i]);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "common.h"
+#include "Objects.h"
+#include "ThreadPool.h"
+
+#define BACKGROUND_MATERIAL 0xFFFF
+
+//Per pixel guides written by the primary rays
+struct GBuffer
+{
+	std::vector<float> depth;
+	std::vector<glm::vec3> normal;
+	std::vector<MaterialId> material;
+
+	void Resize(size_t count)
+	{
+		depth.resize(count);
+		normal.resize(count);
+		material.resize(count);
+	}
+
+	void Set(size_t index, float depth2, glm::vec3 normal2, MaterialId material2)
+	{
+		depth[index] = depth2;
+		normal[index] = normal2;
+		material[index] = material2;
+	}
+
+	//Background pixels share one depth, normal and material so they only blend with each other
+	void SetBackground(size_t index)
+	{
+		Set(index, 1e30f, glm::vec3(0.0f, 0.0f, 1.0f), BACKGROUND_MATERIAL);
+	}
+};
+
+struct DenoiseSettings
+{
+	uint32_t iterations = 4;
+	float colorSigma = 0.25f; //Halved after every iteration
+	float normalPower = 32.0f;
+	float depthSigma = 0.02f; //Relative to the depth, scaled by the tap distance
+};
+
+//Edge avoiding a-trous wavelet filter : 5x5 B3 spline taps spread 2^i pixels apart on iteration i, each tap
+//weighted by color, normal, depth and material similarity. Rows are split in bands across the thread pool
+void DenoiseAtrous(ThreadPool& threadPool, glm::uvec2 size, glm::vec3* pixels, const GBuffer& gBuffer, const DenoiseSettings& settings);
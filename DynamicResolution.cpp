@@ -0,0 +1,78 @@
+#include "DynamicResolution.h"
+
+ResolutionController::ResolutionController(const DynamicResolutionSettings& settings)
+	: settings(settings), scale(settings.maxScale), averageFrameTime(0.0f)
+{}
+
+float ResolutionController::Update(float frameTime)
+{
+	if (averageFrameTime == 0.0f)
+		averageFrameTime = frameTime;
+	else
+		averageFrameTime += settings.smoothing * (frameTime - averageFrameTime);
+
+	float error = averageFrameTime / settings.targetFrameTime;
+	if (fabsf(error - 1.0f) <= settings.tolerance)
+		return scale;
+
+	//The pixel count goes with the square of the scale
+	float next = scale / sqrtf(error);
+	next = roundf(next * (float)settings.scaleSteps) / (float)settings.scaleSteps;
+	next = glm::clamp(next, settings.minScale, settings.maxScale);
+
+	//The average was measured at the old scale, predict it at the new one instead of waiting for it to catch up
+	if (next != scale)
+	{
+		averageFrameTime *= (next * next) / (scale * scale);
+		scale = next;
+	}
+
+	return scale;
+}
+
+DynamicResolutionView::DynamicResolutionView(RayMarcher& renderer, glm::uvec2 size, const DynamicResolutionSettings& settings)
+	: renderer(renderer), controller(settings), output(size), lastFrameTime(0.0f)
+{}
+
+RenderTarget& DynamicResolutionView::GetInternalTarget(float scale)
+{
+	glm::uvec2 size = glm::max(glm::uvec2(glm::round(glm::vec2(output.size) * scale)), glm::uvec2(1, 1));
+	if (size == output.size)
+	{
+		internal.reset();
+		return output;
+	}
+
+	if (!internal || internal->size != size)
+		internal = std::make_unique<RenderTarget>(size);
+
+	return *internal;
+}
+
+glm::vec3* DynamicResolutionView::Render(const Scene& scene, const Camera& camera)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const DynamicResolutionSettings& settings = controller.GetSettings();
+
+	RenderTarget& target = GetInternalTarget(controller.GetScale());
+	renderer.Render(scene, camera, target);
+
+	if (&target != &output)
+	{
+		UpscaleImage(renderer.GetThreadPool(), target.size, target.pixels.data(), output.size, output.pixels.data());
+
+		if (settings.foveation)
+		{
+			glm::vec2 center = settings.foveaCenter * glm::vec2(output.size);
+			glm::vec2 radius = glm::vec2(settings.foveaRadius * (float)output.size.y);
+			glm::uvec2 regionMin = glm::uvec2(glm::max(center - radius, glm::vec2(0.0f)));
+			glm::uvec2 regionMax = glm::uvec2(glm::max(center + radius, glm::vec2(0.0f)));
+			renderer.RenderRegion(scene, camera, output, regionMin, regionMax);
+		}
+	}
+
+	lastFrameTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	controller.Update(lastFrameTime);
+
+	return output.pixels.data();
+}
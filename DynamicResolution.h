@@ -0,0 +1,73 @@
+#pragma once
+#include "common.h"
+#include "RayMarcher.h"
+#include "Upscaler.h"
+
+struct DynamicResolutionSettings
+{
+	float targetFrameTime = 1.0f / 30.0f; //Seconds
+
+	//Fraction of the output size along each axis, quantized to 1 / scaleSteps so the internal target is rebuilt rarely
+	float minScale = 0.25f;
+	float maxScale = 1.0f;
+	uint32_t scaleSteps = 16;
+
+	float smoothing = 0.25f; //Weight of the newest frame in the frame time average
+	float tolerance = 0.1f; //Relative frame time error left alone, keeps the scale from flickering between two steps
+
+	//Tiles around the focus point are rendered again at the output resolution, the rest of the image stays upscaled
+	bool foveation = false;
+	glm::vec2 foveaCenter = glm::vec2(0.5f, 0.5f); //Relative to the output size
+	float foveaRadius = 0.2f; //Relative to the output height
+};
+
+//Picks the internal resolution from recent frame times, assuming a frame costs in proportion to its pixel count
+class ResolutionController
+{
+private:
+	DynamicResolutionSettings settings;
+	float scale;
+	float averageFrameTime; //0 before the first frame
+
+public:
+	ResolutionController(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+	DynamicResolutionSettings& GetSettings() { return settings; }
+
+	//Takes the last frame time in seconds, returns the scale for the next frame
+	float Update(float frameTime);
+
+	float GetScale() const { return scale; }
+	float GetAverageFrameTime() const { return averageFrameTime; }
+};
+
+//Renders a view at the controller's internal resolution and upscales it to a fixed output size
+//Every Render call measures itself and feeds the time to the controller, so the next frame adapts
+class DynamicResolutionView
+{
+private:
+	RayMarcher& renderer;
+	ResolutionController controller;
+
+	RenderTarget output;
+	std::unique_ptr<RenderTarget> internal; //nullptr at full scale, the output is rendered directly then
+
+	float lastFrameTime;
+
+	RenderTarget& GetInternalTarget(float scale);
+
+public:
+	DynamicResolutionView(RayMarcher& renderer, glm::uvec2 size, const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+	DynamicResolutionView(const DynamicResolutionView&) = delete;
+	DynamicResolutionView& operator=(const DynamicResolutionView&) = delete;
+
+	DynamicResolutionSettings& GetSettings() { return controller.GetSettings(); }
+	const ResolutionController& GetController() const { return controller; }
+
+	//Returns the output image
+	glm::vec3* Render(const Scene& scene, const Camera& camera);
+
+	glm::uvec2 GetSize() const { return output.size; }
+	glm::uvec2 GetInternalSize() const { return internal ? internal->size : output.size; }
+	float GetLastFrameTime() const { return lastFrameTime; }
+};
@@ -0,0 +1,374 @@
+#include "Objects.h"
+
+//Interval arithmetic over the entity tree
+//Every combining operator is non-decreasing in each operand, so its range follows from evaluating it on the
+//lower and the upper ends of the operand ranges
+
+static Interval Abs(float min, float max)
+{
+	if (min >= 0.0f)
+		return { min, max };
+	if (max <= 0.0f)
+		return { -max, -min };
+	return { 0.0f, glm::max(-min, max) };
+}
+
+//Range of |position - center| per axis over the region
+static void RelativeRange(const Bounds& region, glm::vec3 center, glm::vec3& nearest, glm::vec3& farthest)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		Interval range = Abs(region.min[i] - center[i], region.max[i] - center[i]);
+		nearest[i] = range.min;
+		farthest[i] = range.max;
+	}
+}
+
+//Same blends as the smooth operators, whose constructors assert k is positive
+static float SmoothMin(float distance1, float distance2, float k)
+{
+	float h = glm::clamp(0.5f + 0.5f * (distance2 - distance1) / k, 0.0f, 1.0f);
+	return glm::mix(distance2, distance1, h) - k * h * (1.0f - h);
+}
+
+static float SmoothMax(float distance1, float distance2, float k)
+{
+	float h = glm::clamp(0.5f - 0.5f * (distance2 - distance1) / k, 0.0f, 1.0f);
+	return glm::mix(distance2, distance1, h) + k * h * (1.0f - h);
+}
+
+static float CubicSmoothMin(float distance1, float distance2, float k)
+{
+	float h = glm::max(k - glm::abs(distance1 - distance2), 0.0f) / k;
+	return glm::min(distance1, distance2) - h * h * h * k * (1.0f / 6.0f);
+}
+
+//Rebuilds a binary operator around pruned operands, the original is kept when nothing changed
+template<typename T>
+static Entity* PruneOperands(T* entity, SceneArena& arena, const Bounds& region)
+{
+	Entity* entity1 = entity->entity1->Prune(arena, region);
+	Entity* entity2 = entity->entity2->Prune(arena, region);
+	if (entity1 == entity->entity1 && entity2 == entity->entity2)
+		return entity;
+
+	T* pruned = arena.Create<T>(*entity);
+	pruned->entity1 = entity1;
+	pruned->entity2 = entity2;
+	return pruned;
+}
+
+Interval Sphere::CalculateDistanceInterval(const Bounds& region)
+{
+	glm::vec3 nearest, farthest;
+	RelativeRange(region, center, nearest, farthest);
+	return { glm::length(nearest) - radius, glm::length(farthest) - radius };
+}
+
+Interval Box::CalculateDistanceInterval(const Bounds& region)
+{
+	glm::vec3 nearest, farthest;
+	RelativeRange(region, center, nearest, farthest);
+
+	glm::vec3 qMin = nearest - extents, qMax = farthest - extents;
+	return {
+		glm::length(glm::max(qMin, 0.0f)) + glm::min(glm::max(qMin.x, glm::max(qMin.y, qMin.z)), 0.0f),
+		glm::length(glm::max(qMax, 0.0f)) + glm::min(glm::max(qMax.x, glm::max(qMax.y, qMax.z)), 0.0f),
+	};
+}
+
+Interval Torus::CalculateDistanceInterval(const Bounds& region)
+{
+	glm::vec3 nearest, farthest;
+	RelativeRange(region, center, nearest, farthest);
+
+	Interval ring = Abs(glm::length(glm::vec2(nearest.x, nearest.z)) - radii.x, glm::length(glm::vec2(farthest.x, farthest.z)) - radii.x);
+	return {
+		glm::length(glm::vec2(ring.min, nearest.y)) - radii.y,
+		glm::length(glm::vec2(ring.max, farthest.y)) - radii.y,
+	};
+}
+
+Interval Union::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval = { FLT_MAX, FLT_MAX };
+	for (Entity* entity : entities)
+	{
+		Interval child = entity->CalculateDistanceInterval(region);
+		interval.min = glm::min(interval.min, child.min);
+		interval.max = glm::min(interval.max, child.max);
+	}
+	return interval;
+}
+
+Entity* Union::Prune(SceneArena& arena, const Bounds& region)
+{
+	//A child whose lowest distance is above the lowest upper bound never gives the minimum in the region
+	std::vector<Interval> intervals;
+	float bound = FLT_MAX;
+	for (Entity* entity : entities)
+	{
+		intervals.push_back(entity->CalculateDistanceInterval(region));
+		bound = glm::min(bound, intervals.back().max);
+	}
+
+	std::vector<Entity*> children;
+	for (size_t i = 0; i < entities.size(); i++)
+	{
+		if (intervals[i].min <= bound)
+			children.push_back(entities[i]->Prune(arena, region));
+	}
+
+	if (children.size() == 1)
+		return children[0];
+	if (children == entities)
+		return this;
+
+	return arena.Create<Union>(children);
+}
+
+Interval Intersection::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+	return { glm::max(interval1.min, interval2.min), glm::max(interval1.max, interval2.max) };
+}
+
+Entity* Intersection::Prune(SceneArena& arena, const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+
+	if (interval1.min > interval2.max)
+		return entity1->Prune(arena, region);
+	if (interval2.min > interval1.max)
+		return entity2->Prune(arena, region);
+
+	return PruneOperands(this, arena, region);
+}
+
+Interval Difference::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+	return { glm::max(interval1.min, -interval2.max), glm::max(interval1.max, -interval2.min) };
+}
+
+Entity* Difference::Prune(SceneArena& arena, const Bounds& region)
+{
+	//Only the carving can be dropped, a region left entirely carved still needs the negated operand
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+
+	if (interval1.min > -interval2.min)
+		return entity1->Prune(arena, region);
+
+	return PruneOperands(this, arena, region);
+}
+
+Interval SmoothUnion::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+	return { SmoothMin(interval1.min, interval2.min, k), SmoothMin(interval1.max, interval2.max, k) };
+}
+
+Entity* SmoothUnion::Prune(SceneArena& arena, const Bounds& region)
+{
+	//Operands further apart than k do not blend, the closer one is the exact result
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+
+	if (interval2.min - interval1.max >= k)
+		return entity1->Prune(arena, region);
+	if (interval1.min - interval2.max >= k)
+		return entity2->Prune(arena, region);
+
+	return PruneOperands(this, arena, region);
+}
+
+Interval SmoothIntersection::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+	return { SmoothMax(interval1.min, interval2.min, k), SmoothMax(interval1.max, interval2.max, k) };
+}
+
+Entity* SmoothIntersection::Prune(SceneArena& arena, const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+
+	if (interval1.min - interval2.max >= k)
+		return entity1->Prune(arena, region);
+	if (interval2.min - interval1.max >= k)
+		return entity2->Prune(arena, region);
+
+	return PruneOperands(this, arena, region);
+}
+
+Interval SmoothDifference::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+	return { SmoothMax(interval1.min, -interval2.max, k), SmoothMax(interval1.max, -interval2.min, k) };
+}
+
+Entity* SmoothDifference::Prune(SceneArena& arena, const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+
+	if (interval1.min + interval2.min >= k)
+		return entity1->Prune(arena, region);
+
+	return PruneOperands(this, arena, region);
+}
+
+Interval CubicSmoothUnion::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+	return { CubicSmoothMin(interval1.min, interval2.min, k), CubicSmoothMin(interval1.max, interval2.max, k) };
+}
+
+Entity* CubicSmoothUnion::Prune(SceneArena& arena, const Bounds& region)
+{
+	Interval interval1 = entity1->CalculateDistanceInterval(region);
+	Interval interval2 = entity2->CalculateDistanceInterval(region);
+
+	if (interval2.min - interval1.max >= k)
+		return entity1->Prune(arena, region);
+	if (interval1.min - interval2.max >= k)
+		return entity2->Prune(arena, region);
+
+	return PruneOperands(this, arena, region);
+}
+
+Interval SphereSet::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval = { FLT_MAX, FLT_MAX };
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		Interval sphere = Sphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i], materials[i]).CalculateDistanceInterval(region);
+		interval.min = glm::min(interval.min, sphere.min);
+		interval.max = glm::min(interval.max, sphere.max);
+	}
+	return interval;
+}
+
+Entity* SphereSet::Prune(SceneArena& arena, const Bounds& region)
+{
+	std::vector<Interval> intervals;
+	float bound = FLT_MAX;
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		intervals.push_back(Sphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i], materials[i]).CalculateDistanceInterval(region));
+		bound = glm::min(bound, intervals.back().max);
+	}
+
+	size_t count = 0;
+	for (const Interval& interval : intervals)
+		count += interval.min <= bound;
+	if (count == materials.size())
+		return this;
+
+	SphereSet* pruned = arena.Create<SphereSet>();
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (intervals[i].min <= bound)
+			pruned->Add(Sphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i], materials[i]));
+	}
+	return pruned;
+}
+
+Interval BoxSet::CalculateDistanceInterval(const Bounds& region)
+{
+	Interval interval = { FLT_MAX, FLT_MAX };
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		Box box = Box(glm::vec3(centerX[i], centerY[i], centerZ[i]), glm::vec3(extentX[i], extentY[i], extentZ[i]), materials[i]);
+		Interval child = box.CalculateDistanceInterval(region);
+		interval.min = glm::min(interval.min, child.min);
+		interval.max = glm::min(interval.max, child.max);
+	}
+	return interval;
+}
+
+Entity* BoxSet::Prune(SceneArena& arena, const Bounds& region)
+{
+	std::vector<Box> boxes;
+	std::vector<Interval> intervals;
+	float bound = FLT_MAX;
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		boxes.push_back(Box(glm::vec3(centerX[i], centerY[i], centerZ[i]), glm::vec3(extentX[i], extentY[i], extentZ[i]), materials[i]));
+		intervals.push_back(boxes.back().CalculateDistanceInterval(region));
+		bound = glm::min(bound, intervals.back().max);
+	}
+
+	size_t count = 0;
+	for (const Interval& interval : intervals)
+		count += interval.min <= bound;
+	if (count == materials.size())
+		return this;
+
+	BoxSet* pruned = arena.Create<BoxSet>();
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		if (intervals[i].min <= bound)
+			pruned->Add(boxes[i]);
+	}
+	return pruned;
+}
+
+//Region covered by the transformed positions of a region
+static Bounds MirrorRegion(const Bounds& region, glm::vec3 center, glm::vec3 axes)
+{
+	Bounds mirrored = region;
+	for (int i = 0; i < 3; i++)
+	{
+		if (axes[i] == 0.0f)
+			continue;
+
+		Interval range = Abs(region.min[i] - center[i], region.max[i] - center[i]);
+		mirrored.min[i] = range.min + center[i];
+		mirrored.max[i] = range.max + center[i];
+	}
+	return mirrored;
+}
+
+Interval Mirror::CalculateDistanceInterval(const Bounds& region)
+{
+	return entity->CalculateDistanceInterval(MirrorRegion(region, center, axes));
+}
+
+Entity* Mirror::Prune(SceneArena& arena, const Bounds& region)
+{
+	Entity* pruned = entity->Prune(arena, MirrorRegion(region, center, axes));
+	if (pruned == entity)
+		return this;
+
+	Mirror* mirror = arena.Create<Mirror>(*this);
+	mirror->entity = pruned;
+	return mirror;
+}
+
+Interval Oscillate::CalculateDistanceInterval(const Bounds& region)
+{
+	glm::vec3 offset = amplitude * glm::sin(*time * frequency);
+	return entity->CalculateDistanceInterval({ region.min - offset, region.max - offset });
+}
+
+Entity* Oscillate::Prune(SceneArena& arena, const Bounds& region)
+{
+	//Only valid for the current time, like the tree it is pruned from the result is rebuilt every frame
+	glm::vec3 offset = amplitude * glm::sin(*time * frequency);
+	Entity* pruned = entity->Prune(arena, { region.min - offset, region.max - offset });
+	if (pruned == entity)
+		return this;
+
+	Oscillate* oscillate = arena.Create<Oscillate>(*this);
+	oscillate->entity = pruned;
+	return oscillate;
+}
@@ -1 +1,327 @@
 #include "Objects.h"
+
+Entity* Union::Optimize(SceneArena& arena)
+{
+	//Fold nested unions into this one
+	std::vector<Entity*> children;
+	std::vector<Entity*> stack(entities.rbegin(), entities.rend());
+	while (!stack.empty())
+	{
+		Entity* entity = stack.back();
+		stack.pop_back();
+
+		if (Union* child = dynamic_cast<Union*>(entity))
+			stack.insert(stack.end(), child->entities.rbegin(), child->entities.rend());
+		else
+			children.push_back(entity->Optimize(arena));
+	}
+
+	//Group same-typed primitives into batches
+	SphereSet* spheres = nullptr;
+	BoxSet* boxes = nullptr;
+
+	entities.clear();
+	for (Entity* entity : children)
+	{
+		if (Sphere* sphere = dynamic_cast<Sphere*>(entity))
+		{
+			if (!spheres)
+				entities.push_back(spheres = arena.Create<SphereSet>());
+			spheres->Add(*sphere);
+		}
+		else if (Box* box = dynamic_cast<Box*>(entity))
+		{
+			if (!boxes)
+				entities.push_back(boxes = arena.Create<BoxSet>());
+			boxes->Add(*box);
+		}
+		else
+			entities.push_back(entity);
+	}
+
+	if (entities.size() == 1)
+		return entities[0];
+
+	return this;
+}
+
+Entity* Union::Clone(SceneArena& arena)
+{
+	Union* clone = arena.Create<Union>(*this);
+	for (Entity*& entity : clone->entities)
+		entity = entity->Clone(arena);
+	return clone;
+}
+
+Bounds Union::GetBounds()
+{
+	Bounds bounds = entities[0]->GetBounds();
+	for (size_t i = 1; i < entities.size(); i++)
+		bounds = bounds.Union(entities[i]->GetBounds());
+	return bounds;
+}
+
+Entity* Union::Cull(SceneArena& arena, const Frustum& frustum)
+{
+	std::vector<Entity*> visible;
+	for (Entity* entity : entities)
+	{
+		if (Entity* culled = entity->Cull(arena, frustum))
+			visible.push_back(culled);
+	}
+
+	if (visible.empty())
+		return nullptr;
+	if (visible.size() == 1)
+		return visible[0];
+	if (visible == entities)
+		return this;
+
+	return arena.Create<Union>(visible);
+}
+
+//The arrays always hold whole batches, an element goes into the first padding lane and a full set grows by a batch
+//Padding lanes get a huge negative radius/extent so they never win the min reduction
+static void GrowBatch(std::vector<float>& values, size_t count, float padding)
+{
+	if (count == values.size())
+		values.resize(count + BATCH_WIDTH, padding);
+}
+
+void SphereSet::Add(const Sphere& sphere)
+{
+	size_t count = materials.size();
+	GrowBatch(centerX, count, 0.0f); GrowBatch(centerY, count, 0.0f); GrowBatch(centerZ, count, 0.0f);
+	GrowBatch(radius, count, -1e18f);
+
+	centerX[count] = sphere.center.x;
+	centerY[count] = sphere.center.y;
+	centerZ[count] = sphere.center.z;
+	radius[count] = sphere.radius;
+	materials.push_back(sphere.material);
+}
+
+Surface SphereSet::CalculateDistanceToSurface(glm::vec3 position)
+{
+	float laneDistance[BATCH_WIDTH];
+	uint32_t laneIndex[BATCH_WIDTH];
+	for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+	{
+		laneDistance[j] = FLT_MAX;
+		laneIndex[j] = 0;
+	}
+
+	const size_t size = radius.size();
+	for (uint32_t i = 0; i < size; i += BATCH_WIDTH)
+	{
+		for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+		{
+			float x = position.x - centerX[i + j];
+			float y = position.y - centerY[i + j];
+			float z = position.z - centerZ[i + j];
+			float distance = sqrtf(x * x + y * y + z * z) - radius[i + j];
+
+			bool closer = distance < laneDistance[j];
+			laneDistance[j] = closer ? distance : laneDistance[j];
+			laneIndex[j] = closer ? i + j : laneIndex[j];
+		}
+	}
+
+	uint32_t best = 0;
+	for (uint32_t j = 1; j < BATCH_WIDTH; j++)
+	{
+		if (laneDistance[j] < laneDistance[best])
+			best = j;
+	}
+
+	Surface surface = {
+		laneDistance[best],
+		materials[laneIndex[best]],
+	};
+
+	return surface;
+}
+
+float SphereSet::CalculateDistance(glm::vec3 position)
+{
+	float laneDistance[BATCH_WIDTH];
+	for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+		laneDistance[j] = FLT_MAX;
+
+	const size_t size = radius.size();
+	for (uint32_t i = 0; i < size; i += BATCH_WIDTH)
+	{
+		for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+		{
+			float x = position.x - centerX[i + j];
+			float y = position.y - centerY[i + j];
+			float z = position.z - centerZ[i + j];
+			laneDistance[j] = fminf(laneDistance[j], sqrtf(x * x + y * y + z * z) - radius[i + j]);
+		}
+	}
+
+	float distance = laneDistance[0];
+	for (uint32_t j = 1; j < BATCH_WIDTH; j++)
+		distance = fminf(distance, laneDistance[j]);
+
+	return distance;
+}
+
+Bounds SphereSet::GetBounds()
+{
+	Bounds bounds = { glm::vec3(BOUNDS_INFINITY), glm::vec3(-BOUNDS_INFINITY) };
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		glm::vec3 center = glm::vec3(centerX[i], centerY[i], centerZ[i]);
+		bounds = bounds.Union({ center - radius[i], center + radius[i] });
+	}
+	return bounds;
+}
+
+//Counts the visible spheres first so a fully visible set is returned as is, which is the common case every frame
+Entity* SphereSet::Cull(SceneArena& arena, const Frustum& frustum)
+{
+	auto getSphere = [this](size_t i) {
+		return Sphere(glm::vec3(centerX[i], centerY[i], centerZ[i]), radius[i], materials[i]);
+	};
+
+	size_t count = 0;
+	for (size_t i = 0; i < materials.size(); i++)
+		count += frustum.Intersects(getSphere(i).GetBounds());
+
+	if (count == 0)
+		return nullptr;
+	if (count == materials.size())
+		return this;
+
+	SphereSet* visible = arena.Create<SphereSet>();
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		Sphere sphere = getSphere(i);
+		if (frustum.Intersects(sphere.GetBounds()))
+			visible->Add(sphere);
+	}
+	return visible;
+}
+
+void BoxSet::Add(const Box& box)
+{
+	size_t count = materials.size();
+	GrowBatch(centerX, count, 0.0f); GrowBatch(centerY, count, 0.0f); GrowBatch(centerZ, count, 0.0f);
+	GrowBatch(extentX, count, -1e18f); GrowBatch(extentY, count, -1e18f); GrowBatch(extentZ, count, -1e18f);
+
+	centerX[count] = box.center.x;
+	centerY[count] = box.center.y;
+	centerZ[count] = box.center.z;
+	extentX[count] = box.extents.x;
+	extentY[count] = box.extents.y;
+	extentZ[count] = box.extents.z;
+	materials.push_back(box.material);
+}
+
+Surface BoxSet::CalculateDistanceToSurface(glm::vec3 position)
+{
+	float laneDistance[BATCH_WIDTH];
+	uint32_t laneIndex[BATCH_WIDTH];
+	for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+	{
+		laneDistance[j] = FLT_MAX;
+		laneIndex[j] = 0;
+	}
+
+	const size_t size = extentX.size();
+	for (uint32_t i = 0; i < size; i += BATCH_WIDTH)
+	{
+		for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+		{
+			float x = fabsf(position.x - centerX[i + j]) - extentX[i + j];
+			float y = fabsf(position.y - centerY[i + j]) - extentY[i + j];
+			float z = fabsf(position.z - centerZ[i + j]) - extentZ[i + j];
+
+			float outsideX = fmaxf(x, 0.0f), outsideY = fmaxf(y, 0.0f), outsideZ = fmaxf(z, 0.0f);
+			float distance = sqrtf(outsideX * outsideX + outsideY * outsideY + outsideZ * outsideZ) + fminf(fmaxf(x, fmaxf(y, z)), 0.0f);
+
+			bool closer = distance < laneDistance[j];
+			laneDistance[j] = closer ? distance : laneDistance[j];
+			laneIndex[j] = closer ? i + j : laneIndex[j];
+		}
+	}
+
+	uint32_t best = 0;
+	for (uint32_t j = 1; j < BATCH_WIDTH; j++)
+	{
+		if (laneDistance[j] < laneDistance[best])
+			best = j;
+	}
+
+	Surface surface = {
+		laneDistance[best],
+		materials[laneIndex[best]],
+	};
+
+	return surface;
+}
+
+float BoxSet::CalculateDistance(glm::vec3 position)
+{
+	float laneDistance[BATCH_WIDTH];
+	for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+		laneDistance[j] = FLT_MAX;
+
+	const size_t size = extentX.size();
+	for (uint32_t i = 0; i < size; i += BATCH_WIDTH)
+	{
+		for (uint32_t j = 0; j < BATCH_WIDTH; j++)
+		{
+			float x = fabsf(position.x - centerX[i + j]) - extentX[i + j];
+			float y = fabsf(position.y - centerY[i + j]) - extentY[i + j];
+			float z = fabsf(position.z - centerZ[i + j]) - extentZ[i + j];
+
+			float outsideX = fmaxf(x, 0.0f), outsideY = fmaxf(y, 0.0f), outsideZ = fmaxf(z, 0.0f);
+			laneDistance[j] = fminf(laneDistance[j], sqrtf(outsideX * outsideX + outsideY * outsideY + outsideZ * outsideZ) + fminf(fmaxf(x, fmaxf(y, z)), 0.0f));
+		}
+	}
+
+	float distance = laneDistance[0];
+	for (uint32_t j = 1; j < BATCH_WIDTH; j++)
+		distance = fminf(distance, laneDistance[j]);
+
+	return distance;
+}
+
+Bounds BoxSet::GetBounds()
+{
+	Bounds bounds = { glm::vec3(BOUNDS_INFINITY), glm::vec3(-BOUNDS_INFINITY) };
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		glm::vec3 center = glm::vec3(centerX[i], centerY[i], centerZ[i]);
+		glm::vec3 extents = glm::vec3(extentX[i], extentY[i], extentZ[i]);
+		bounds = bounds.Union({ center - extents, center + extents });
+	}
+	return bounds;
+}
+
+Entity* BoxSet::Cull(SceneArena& arena, const Frustum& frustum)
+{
+	auto getBox = [this](size_t i) {
+		return Box(glm::vec3(centerX[i], centerY[i], centerZ[i]), glm::vec3(extentX[i], extentY[i], extentZ[i]), materials[i]);
+	};
+
+	size_t count = 0;
+	for (size_t i = 0; i < materials.size(); i++)
+		count += frustum.Intersects(getBox(i).GetBounds());
+
+	if (count == 0)
+		return nullptr;
+	if (count == materials.size())
+		return this;
+
+	BoxSet* visible = arena.Create<BoxSet>();
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		Box box = getBox(i);
+		if (frustum.Intersects(box.GetBounds()))
+			visible->Add(box);
+	}
+	return visible;
+}
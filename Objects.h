@@ -1,28 +1,180 @@
 #pragma once
 #include "common.h"
+#include "SceneArena.h"
 
 struct Material
 {
 	glm::vec3 color = glm::vec3(0.0f, 0.0f, 0.0f);
+	float reflectivity = 1.0f;
+};
+
+inline Material MixMaterials(const Material& material1, const Material& material2, float t)
+{
+	return {
+		glm::mix(material1.color, material2.color, t),
+		glm::mix(material1.reflectivity, material2.reflectivity, t),
+	};
+}
+
+typedef uint16_t MaterialId;
+
+//Scene-wide material storage, entities only keep an index into it
+struct MaterialTable
+{
+	std::vector<glm::vec3> colors;
+	std::vector<float> reflectivities;
+
+	MaterialId Add(const Material& material)
+	{
+		colors.push_back(material.color);
+		reflectivities.push_back(material.reflectivity);
+
+		return (MaterialId)(colors.size() - 1);
+	}
+
+	Material Get(MaterialId material) const
+	{
+		return { colors[material], reflectivities[material] };
+	}
+};
+
+class SceneCodeWriter;
+
+//Variables holding an entity's distance and material in generated code
+struct SurfaceCode
+{
+	std::string distance;
+	std::string material;
 };
 
 struct Surface
 {
 	float distance;
-	Material material;
+	MaterialId material;
+};
+static_assert(sizeof(Surface) <= 8, "Surface is copied at every union, keep it small");
+
+#define BOUNDS_INFINITY 1e30f
+
+//Axis aligned box containing every point where an entity's distance can be negative,
+//unbounded axes reach +-BOUNDS_INFINITY
+struct Bounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	static Bounds Infinite()
+	{
+		return { glm::vec3(-BOUNDS_INFINITY), glm::vec3(BOUNDS_INFINITY) };
+	}
+
+	Bounds Union(const Bounds& bounds) const
+	{
+		return { glm::min(min, bounds.min), glm::max(max, bounds.max) };
+	}
+
+	Bounds Intersect(const Bounds& bounds) const
+	{
+		return { glm::max(min, bounds.min), glm::min(max, bounds.max) };
+	}
+
+	Bounds Inflate(glm::vec3 amount) const
+	{
+		return { glm::max(min - amount, -BOUNDS_INFINITY), glm::min(max + amount, BOUNDS_INFINITY) };
+	}
+
+	bool IsEmpty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+};
+
+//Conservative range of a distance over a region
+struct Interval
+{
+	float min;
+	float max;
+};
+
+//Side planes of a camera frustum, normals point inwards
+struct Frustum
+{
+	glm::vec4 planes[4];
+
+	//Tests the bounding sphere of the box, so it may keep boxes just outside a corner
+	bool Intersects(const Bounds& bounds) const
+	{
+		if (bounds.IsEmpty())
+			return false;
+
+		glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+		float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+		for (const glm::vec4& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		}
+
+		return true;
+	}
 };
 
 struct Entity
 {
 	virtual Surface CalculateDistanceToSurface(glm::vec3 position) = 0;
+
+	//Distance only evaluation, skips all material work (shadow rays, normals)
+	virtual float CalculateDistance(glm::vec3 position)
+	{
+		return CalculateDistanceToSurface(position).distance;
+	}
+
+	//Only called at hit points, entities blending materials override it to return the blended parameters
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials)
+	{
+		return materials.Get(CalculateDistanceToSurface(position).material);
+	}
+
+	//Returns an equivalent entity that is cheaper to evaluate (folds union chains, batches primitives)
+	virtual Entity* Optimize(SceneArena& /*arena*/) { return this; }
+
+	//Deep copies the entity into the arena, parents are placed before their children
+	virtual Entity* Clone(SceneArena& arena) = 0;
+
+	//Conservative, smooth operators inflate their operands by the most the blend can add
+	virtual Bounds GetBounds() = 0;
+
+	//Range of the distance over the region (Intervals.cpp), the default only relies on the distance being 1-Lipschitz
+	virtual Interval CalculateDistanceInterval(const Bounds& region)
+	{
+		glm::vec3 center = (region.min + region.max) * 0.5f;
+		float radius = glm::length(region.max - region.min) * 0.5f;
+		float distance = CalculateDistance(center);
+		return { distance - radius, distance + radius };
+	}
+
+	//Returns an entity with the same distance and materials inside the region, without the min/max operands that
+	//cannot win there (new nodes go to the arena)
+	virtual Entity* Prune(SceneArena& /*arena*/, const Bounds& /*region*/) { return this; }
+
+	//Returns what is left of the entity for rays that stay inside the frustum, nullptr if nothing
+	//Only unions and sets drop parts (new nodes go to the arena), other entities are kept or dropped whole
+	virtual Entity* Cull(SceneArena& /*arena*/, const Frustum& frustum)
+	{
+		return frustum.Intersects(GetBounds()) ? this : nullptr;
+	}
+
+	//Writes the entity as straight line code (SceneCodeWriter.cpp), position is the variable holding the position
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) = 0;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) = 0;
 };
 
 struct Object : public Entity
 {
 	glm::vec3 center;
-	Material material;
+	MaterialId material;
 
-	Object(glm::vec3 center, Material material) :
+	Object(glm::vec3 center, MaterialId material) :
 		center(center),
 		material(material)
 	{}
@@ -32,7 +184,7 @@ struct Sphere : public Object
 {
 	float radius;
 
-	Sphere(glm::vec3 center, float radius, Material material) : Object(center, material),
+	Sphere(glm::vec3 center, float radius, MaterialId material) : Object(center, material),
 		radius(radius)
 	{}
 
@@ -45,13 +197,32 @@ struct Sphere : public Object
 
 		return surface;
 	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return length(position - center) - radius;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return arena.Create<Sphere>(*this);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return { center - radius, center + radius };
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
 };
 
 struct Box : public Object
 {
 	glm::vec3 extents;
 
-	Box(glm::vec3 center, glm::vec3 extents, Material material) : Object(center, material),
+	Box(glm::vec3 center, glm::vec3 extents, MaterialId material) : Object(center, material),
 		extents(extents)
 	{}
 
@@ -65,54 +236,866 @@ struct Box : public Object
 
 		return surface;
 	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		glm::vec3 q = abs(position - center) - extents;
+		return glm::length(glm::max(q, glm::vec3(0.0f, 0.0f, 0.0f))) + glm::min(glm::max(q.x, glm::max(q.y, q.z)), 0.0f);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return arena.Create<Box>(*this);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return { center - extents, center + extents };
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+//Ring lying in the xz plane around center, radii.x is the ring radius and radii.y the tube radius
+struct Torus : public Object
+{
+	glm::vec2 radii;
+
+	Torus(glm::vec3 center, glm::vec2 radii, MaterialId material) : Object(center, material),
+		radii(radii)
+	{}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface = {
+			CalculateDistance(position),
+			material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		glm::vec3 p = position - center;
+		glm::vec2 q = glm::vec2(glm::length(glm::vec2(p.x, p.z)) - radii.x, p.y);
+		return glm::length(q) - radii.y;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return arena.Create<Torus>(*this);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		glm::vec3 extents = glm::vec3(radii.x + radii.y, radii.y, radii.x + radii.y);
+		return { center - extents, center + extents };
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
 };
 
 struct Union : public Entity
 {
-	Entity* entity1, * entity2;
+	std::vector<Entity*> entities; //Never empty, the distance starts from the first entity
 
 	Union(Entity* entity1, Entity* entity2) :
+		entities({ entity1, entity2 })
+	{}
+	Union(std::vector<Entity*> entities) :
+		entities(std::move(entities))
+	{
+		assert(!this->entities.empty());
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface = entities[0]->CalculateDistanceToSurface(position);
+
+		for (size_t i = 1; i < entities.size(); i++)
+		{
+			Surface surface2 = entities[i]->CalculateDistanceToSurface(position);
+			if (surface2.distance < surface.distance)
+				surface = surface2;
+		}
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		float distance = entities[0]->CalculateDistance(position);
+		for (size_t i = 1; i < entities.size(); i++)
+			distance = glm::min(distance, entities[i]->CalculateDistance(position));
+
+		return distance;
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		size_t closest = 0;
+		float distance = entities[0]->CalculateDistance(position);
+
+		for (size_t i = 1; i < entities.size(); i++)
+		{
+			float distance2 = entities[i]->CalculateDistance(position);
+			if (distance2 < distance)
+			{
+				closest = i;
+				distance = distance2;
+			}
+		}
+
+		return entities[closest]->CalculateMaterial(position, materials);
+	}
+
+	virtual Entity* Optimize(SceneArena& arena) override;
+	virtual Entity* Clone(SceneArena& arena) override;
+	virtual Bounds GetBounds() override;
+	virtual Entity* Cull(SceneArena& arena, const Frustum& frustum) override;
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+struct Union3 : public Union
+{
+	Union3(Entity* entity1, Entity* entity2, Entity* entity3) :
+		Union({ entity1, entity2, entity3 })
+	{}
+};
+
+//Binary CSG operators
+//The smooth variants use the quadratic polynomial blend, whose gradient is a convex combination of
+//the operand gradients, so the result keeps the operands' Lipschitz bound and needs no step scaling
+
+struct BinaryOperator : public Entity
+{
+	Entity* entity1, * entity2;
+
+	BinaryOperator(Entity* entity1, Entity* entity2) :
 		entity1(entity1), entity2(entity2)
 	{}
 
+	virtual Entity* Optimize(SceneArena& arena) override
+	{
+		entity1 = entity1->Optimize(arena);
+		entity2 = entity2->Optimize(arena);
+		return this;
+	}
+
+protected:
+	template<typename T>
+	Entity* CloneOperator(SceneArena& arena)
+	{
+		T* clone = arena.Create<T>(*(T*)this);
+		clone->entity1 = entity1->Clone(arena);
+		clone->entity2 = entity2->Clone(arena);
+		return clone;
+	}
+};
+
+struct Intersection : public BinaryOperator
+{
+	Intersection(Entity* entity1, Entity* entity2) : BinaryOperator(entity1, entity2)
+	{}
+
 	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
 	{
 		Surface surface1 = entity1->CalculateDistanceToSurface(position);
 		Surface surface2 = entity2->CalculateDistanceToSurface(position);
 
-		if (surface1.distance < surface2.distance)
-			return surface1;
-		else
-			return surface2;
+		Surface surface = {
+			glm::max(surface1.distance, surface2.distance),
+			surface1.distance > surface2.distance ? surface1.material : surface2.material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return glm::max(entity1->CalculateDistance(position), entity2->CalculateDistance(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		return (distance1 > distance2 ? entity1 : entity2)->CalculateMaterial(position, materials);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return CloneOperator<Intersection>(arena);
 	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity1->GetBounds().Intersect(entity2->GetBounds());
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
 };
-struct Union3 : public Entity
-{
-	Entity* entity1, * entity2, * entity3;
 
-	Union3(Entity* entity1, Entity* entity2, Entity* entity3) :
-		entity1(entity1), entity2(entity2), entity3(entity3)
+//Subtracts entity2 from entity1, the carved surface takes entity2's material
+struct Difference : public BinaryOperator
+{
+	Difference(Entity* entity1, Entity* entity2) : BinaryOperator(entity1, entity2)
 	{}
 
 	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
 	{
 		Surface surface1 = entity1->CalculateDistanceToSurface(position);
 		Surface surface2 = entity2->CalculateDistanceToSurface(position);
-		Surface surface3 = entity3->CalculateDistanceToSurface(position);
 
-		if (surface1.distance < surface2.distance)
-		{
-			if (surface1.distance < surface3.distance)
-				return surface1;
-			else
-				return surface3;
-		}
-		else
+		Surface surface = {
+			glm::max(surface1.distance, -surface2.distance),
+			surface1.distance > -surface2.distance ? surface1.material : surface2.material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return glm::max(entity1->CalculateDistance(position), -entity2->CalculateDistance(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		return (distance1 > -distance2 ? entity1 : entity2)->CalculateMaterial(position, materials);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return CloneOperator<Difference>(arena);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity1->GetBounds();
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct SmoothUnion : public BinaryOperator
+{
+	float k; //Blend radius, must be positive
+	bool blendMaterials;
+
+	SmoothUnion(Entity* entity1, Entity* entity2, float k, bool blendMaterials = true) : BinaryOperator(entity1, entity2),
+		k(k), blendMaterials(blendMaterials)
+	{
+		assert(k > 0.0f);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface1 = entity1->CalculateDistanceToSurface(position);
+		Surface surface2 = entity2->CalculateDistanceToSurface(position);
+
+		float h = glm::clamp(0.5f + 0.5f * (surface2.distance - surface1.distance) / k, 0.0f, 1.0f);
+		Surface surface = {
+			glm::mix(surface2.distance, surface1.distance, h) - k * h * (1.0f - h),
+			h >= 0.5f ? surface1.material : surface2.material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::clamp(0.5f + 0.5f * (distance2 - distance1) / k, 0.0f, 1.0f);
+		return glm::mix(distance2, distance1, h) - k * h * (1.0f - h);
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::clamp(0.5f + 0.5f * (distance2 - distance1) / k, 0.0f, 1.0f);
+		if (!blendMaterials)
+			return (h >= 0.5f ? entity1 : entity2)->CalculateMaterial(position, materials);
+
+		return MixMaterials(entity2->CalculateMaterial(position, materials), entity1->CalculateMaterial(position, materials), h);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return CloneOperator<SmoothUnion>(arena);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		//The blend lowers the distance by at most k / 4, where both operands are equal
+		return entity1->GetBounds().Union(entity2->GetBounds()).Inflate(glm::vec3(k * 0.25f));
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct SmoothIntersection : public BinaryOperator
+{
+	float k; //Blend radius, must be positive
+	bool blendMaterials;
+
+	SmoothIntersection(Entity* entity1, Entity* entity2, float k, bool blendMaterials = true) : BinaryOperator(entity1, entity2),
+		k(k), blendMaterials(blendMaterials)
+	{
+		assert(k > 0.0f);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface1 = entity1->CalculateDistanceToSurface(position);
+		Surface surface2 = entity2->CalculateDistanceToSurface(position);
+
+		float h = glm::clamp(0.5f - 0.5f * (surface2.distance - surface1.distance) / k, 0.0f, 1.0f);
+		Surface surface = {
+			glm::mix(surface2.distance, surface1.distance, h) + k * h * (1.0f - h),
+			h >= 0.5f ? surface1.material : surface2.material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::clamp(0.5f - 0.5f * (distance2 - distance1) / k, 0.0f, 1.0f);
+		return glm::mix(distance2, distance1, h) + k * h * (1.0f - h);
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::clamp(0.5f - 0.5f * (distance2 - distance1) / k, 0.0f, 1.0f);
+		if (!blendMaterials)
+			return (h >= 0.5f ? entity1 : entity2)->CalculateMaterial(position, materials);
+
+		return MixMaterials(entity2->CalculateMaterial(position, materials), entity1->CalculateMaterial(position, materials), h);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return CloneOperator<SmoothIntersection>(arena);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity1->GetBounds().Intersect(entity2->GetBounds());
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+//Subtracts entity2 from entity1
+struct SmoothDifference : public BinaryOperator
+{
+	float k; //Blend radius, must be positive
+	bool blendMaterials;
+
+	SmoothDifference(Entity* entity1, Entity* entity2, float k, bool blendMaterials = true) : BinaryOperator(entity1, entity2),
+		k(k), blendMaterials(blendMaterials)
+	{
+		assert(k > 0.0f);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface1 = entity1->CalculateDistanceToSurface(position);
+		Surface surface2 = entity2->CalculateDistanceToSurface(position);
+
+		float h = glm::clamp(0.5f - 0.5f * (surface1.distance + surface2.distance) / k, 0.0f, 1.0f);
+		Surface surface = {
+			glm::mix(surface1.distance, -surface2.distance, h) + k * h * (1.0f - h),
+			h >= 0.5f ? surface2.material : surface1.material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::clamp(0.5f - 0.5f * (distance1 + distance2) / k, 0.0f, 1.0f);
+		return glm::mix(distance1, -distance2, h) + k * h * (1.0f - h);
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::clamp(0.5f - 0.5f * (distance1 + distance2) / k, 0.0f, 1.0f);
+		if (!blendMaterials)
+			return (h >= 0.5f ? entity2 : entity1)->CalculateMaterial(position, materials);
+
+		return MixMaterials(entity1->CalculateMaterial(position, materials), entity2->CalculateMaterial(position, materials), h);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return CloneOperator<SmoothDifference>(arena);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity1->GetBounds();
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+//Cubic smooth minimum, blends over a wider band than SmoothUnion for the same k, the material is the closest operand's
+struct CubicSmoothUnion : public BinaryOperator
+{
+	float k; //Blend radius, must be positive
+
+	CubicSmoothUnion(Entity* entity1, Entity* entity2, float k) : BinaryOperator(entity1, entity2),
+		k(k)
+	{
+		assert(k > 0.0f);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface1 = entity1->CalculateDistanceToSurface(position);
+		Surface surface2 = entity2->CalculateDistanceToSurface(position);
+
+		float h = glm::max(k - glm::abs(surface1.distance - surface2.distance), 0.0f) / k;
+		Surface surface = {
+			glm::min(surface1.distance, surface2.distance) - h * h * h * k * (1.0f / 6.0f),
+			surface1.distance < surface2.distance ? surface1.material : surface2.material,
+		};
+
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		float h = glm::max(k - glm::abs(distance1 - distance2), 0.0f) / k;
+		return glm::min(distance1, distance2) - h * h * h * k * (1.0f / 6.0f);
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		float distance1 = entity1->CalculateDistance(position);
+		float distance2 = entity2->CalculateDistance(position);
+
+		return (distance1 < distance2 ? entity1 : entity2)->CalculateMaterial(position, materials);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return CloneOperator<CubicSmoothUnion>(arena);
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity1->GetBounds().Union(entity2->GetBounds()).Inflate(glm::vec3(k / 6.0f));
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+//Structure of arrays batches of primitives, evaluated BatchWidth children at a time
+//Created by Union::Optimize from same-typed children, the min reduction is kept per lane so it vectorizes
+
+#define BATCH_WIDTH 8
+
+struct SphereSet : public Entity
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> radius;
+	std::vector<MaterialId> materials;
+
+	void Add(const Sphere& sphere);
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override;
+	virtual float CalculateDistance(glm::vec3 position) override;
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return arena.Create<SphereSet>(*this);
+	}
+
+	virtual Bounds GetBounds() override;
+	virtual Entity* Cull(SceneArena& arena, const Frustum& frustum) override;
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct BoxSet : public Entity
+{
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<MaterialId> materials;
+
+	void Add(const Box& box);
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override;
+	virtual float CalculateDistance(glm::vec3 position) override;
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return arena.Create<BoxSet>(*this);
+	}
+
+	virtual Bounds GetBounds() override;
+	virtual Entity* Cull(SceneArena& arena, const Frustum& frustum) override;
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+//Domain operators : transform the position before evaluating the entity, so every instance costs the same as one
+
+struct Repeat : public Entity
+{
+	Entity* entity;
+	glm::vec3 period;
+
+	//A period of 0 disables repetition on that axis
+	Repeat(Entity* entity, glm::vec3 period) :
+		entity(entity), period(period)
+	{}
+
+	glm::vec3 Transform(glm::vec3 position) const
+	{
+		glm::vec3 mask = glm::step(glm::vec3(1e-6f), period);
+		glm::vec3 safePeriod = glm::max(period, glm::vec3(1e-6f));
+		return position - mask * safePeriod * glm::round(position / safePeriod);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		return entity->CalculateDistanceToSurface(Transform(position));
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return entity->CalculateDistance(Transform(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		return entity->CalculateMaterial(Transform(position), materials);
+	}
+
+	virtual Entity* Optimize(SceneArena& arena) override
+	{
+		entity = entity->Optimize(arena);
+		return this;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		Repeat* clone = arena.Create<Repeat>(*this);
+		clone->entity = entity->Clone(arena);
+		return clone;
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		Bounds bounds = entity->GetBounds();
+		for (uint32_t i = 0; i < 3; i++)
 		{
-			if (surface2.distance < surface3.distance)
-				return surface2;
-			else
-				return surface3;
+			if (period[i] > 1e-6f)
+			{
+				bounds.min[i] = -BOUNDS_INFINITY;
+				bounds.max[i] = BOUNDS_INFINITY;
+			}
 		}
+		return bounds;
+	}
+
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct RepeatLimited : public Entity
+{
+	Entity* entity;
+	glm::vec3 period;
+	glm::vec3 limit;
+
+	//Repeats the entity limit * 2 + 1 times along each axis, centered on the origin
+	RepeatLimited(Entity* entity, glm::vec3 period, glm::uvec3 limit) :
+		entity(entity), period(period), limit(limit)
+	{}
+
+	glm::vec3 Transform(glm::vec3 position) const
+	{
+		glm::vec3 mask = glm::step(glm::vec3(1e-6f), period);
+		glm::vec3 safePeriod = glm::max(period, glm::vec3(1e-6f));
+		return position - mask * safePeriod * glm::clamp(glm::round(position / safePeriod), -limit, limit);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		return entity->CalculateDistanceToSurface(Transform(position));
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return entity->CalculateDistance(Transform(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		return entity->CalculateMaterial(Transform(position), materials);
+	}
+
+	virtual Entity* Optimize(SceneArena& arena) override
+	{
+		entity = entity->Optimize(arena);
+		return this;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		RepeatLimited* clone = arena.Create<RepeatLimited>(*this);
+		clone->entity = entity->Clone(arena);
+		return clone;
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity->GetBounds().Inflate(glm::step(glm::vec3(1e-6f), period) * period * limit);
+	}
+
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct Mirror : public Entity
+{
+	Entity* entity;
+	glm::vec3 center;
+	glm::vec3 axes;
+
+	//Mirrors the positive half space of each selected axis (1 = mirrored, 0 = unchanged) around center
+	Mirror(Entity* entity, glm::vec3 center, glm::bvec3 axes) :
+		entity(entity), center(center), axes(axes)
+	{}
+
+	glm::vec3 Transform(glm::vec3 position) const
+	{
+		glm::vec3 q = position - center;
+		return glm::mix(q, glm::abs(q), axes) + center;
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		return entity->CalculateDistanceToSurface(Transform(position));
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return entity->CalculateDistance(Transform(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		return entity->CalculateMaterial(Transform(position), materials);
+	}
+
+	virtual Entity* Optimize(SceneArena& arena) override
+	{
+		entity = entity->Optimize(arena);
+		return this;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		Mirror* clone = arena.Create<Mirror>(*this);
+		clone->entity = entity->Clone(arena);
+		return clone;
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		//Either side of a mirrored axis reaches as far as the farthest child bound
+		Bounds bounds = entity->GetBounds();
+		glm::vec3 extents = glm::max(glm::abs(bounds.min - center), glm::abs(bounds.max - center));
+		bounds.min = glm::mix(bounds.min, center - extents, axes);
+		bounds.max = glm::mix(bounds.max, center + extents, axes);
+		return bounds;
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct PolarRepeat : public Entity
+{
+	Entity* entity;
+	glm::vec3 center;
+	float angle;
+
+	//Repeats the entity count times around the y axis going through center
+	PolarRepeat(Entity* entity, glm::vec3 center, uint32_t count) :
+		entity(entity), center(center), angle(glm::two_pi<float>() / (float)glm::max(count, 1u))
+	{}
+
+	glm::vec3 Transform(glm::vec3 position) const
+	{
+		glm::vec3 q = position - center;
+
+		float a = atan2(q.z, q.x) + angle * 0.5f;
+		a = a - angle * glm::floor(a / angle) - angle * 0.5f;
+		float radius = glm::length(glm::vec2(q.x, q.z));
+
+		return glm::vec3(cos(a) * radius, q.y, sin(a) * radius) + center;
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		return entity->CalculateDistanceToSurface(Transform(position));
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return entity->CalculateDistance(Transform(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		return entity->CalculateMaterial(Transform(position), materials);
+	}
+
+	virtual Entity* Optimize(SceneArena& arena) override
+	{
+		entity = entity->Optimize(arena);
+		return this;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		PolarRepeat* clone = arena.Create<PolarRepeat>(*this);
+		clone->entity = entity->Clone(arena);
+		return clone;
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		Bounds bounds = entity->GetBounds();
+		glm::vec2 extents = glm::max(glm::abs(glm::vec2(bounds.min.x, bounds.min.z) - glm::vec2(center.x, center.z)),
+			glm::abs(glm::vec2(bounds.max.x, bounds.max.z) - glm::vec2(center.x, center.z)));
+		float radius = glm::min(glm::length(extents), BOUNDS_INFINITY);
+		bounds.min = glm::vec3(center.x - radius, bounds.min.y, center.z - radius);
+		bounds.max = glm::vec3(center.x + radius, bounds.max.y, center.z + radius);
+		return bounds;
+	}
+
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
+};
+
+struct Oscillate : public Entity
+{
+	Entity* entity;
+	glm::vec3 amplitude;
+	float frequency;
+	const float* time;
+
+	//Moves the entity by amplitude * sin(time * frequency), time is read on every evaluation so the owner of the
+	//clock animates the scene without rebuilding it
+	Oscillate(Entity* entity, glm::vec3 amplitude, float frequency, const float* time) :
+		entity(entity), amplitude(amplitude), frequency(frequency), time(time)
+	{}
+
+	glm::vec3 Transform(glm::vec3 position) const
+	{
+		return position - amplitude * glm::sin(*time * frequency);
+	}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		return entity->CalculateDistanceToSurface(Transform(position));
 	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return entity->CalculateDistance(Transform(position));
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		return entity->CalculateMaterial(Transform(position), materials);
+	}
+
+	virtual Entity* Optimize(SceneArena& arena) override
+	{
+		entity = entity->Optimize(arena);
+		return this;
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		Oscillate* clone = arena.Create<Oscillate>(*this);
+		clone->entity = entity->Clone(arena);
+		return clone;
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return entity->GetBounds().Inflate(glm::abs(amplitude));
+	}
+
+	virtual Interval CalculateDistanceInterval(const Bounds& region) override;
+	virtual Entity* Prune(SceneArena& arena, const Bounds& region) override;
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override;
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override;
 };
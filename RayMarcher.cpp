@@ -1,167 +1,1204 @@
 #include "RayMarcher.h"
 
-RayMarcher::RayMarcher(glm::uvec2 size, float fov)
-	: size(size), aspectRatio((float)size.x / (float)size.y),
-	fovFactor(1.0f / tan(fov)),
-	cameraPosition(glm::vec3(-6.0f, 3.0f, -6.0f)),
-	pixels(new glm::vec3[size.x * size.y])
-{
-	memset(pixels, 0.0f, sizeof(glm::vec3) * size.x * size.y);
-
-	glm::mat4 matrix(1.0f);
-	matrix = glm::rotate(matrix, 0.7f, glm::vec3(0.0f, 1.0f, 0.0f));
-	matrix = glm::rotate(matrix, 0.48f, glm::vec3(1.0f, 0.0f, 0.0f));
-
-	cameraRotation = glm::mat3(matrix);
-
-	//Create scene
-	scene = new Union(
-		new Union(
-			new Sphere(glm::vec3(0.0f, 0.0f, -12.0f), 7.0f, { glm::vec3(0.9f, 0.999f, 0.999f) }),
-			new Sphere(glm::vec3(-1.5f, 0.0f, 0.0f), 1.0f, { glm::vec3(0.999f, 0.9f, 0.9f) })
-		),
-		new Union3(
-			new Box(glm::vec3(20.0f, 0.0f, 0.0f), glm::vec3(0.001f, 5.0f, 5.0f), { glm::vec3(0.999f, 0.9f, 0.9f) }),
-			new Box(glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(5.0f, 5.0f, 0.001f), { glm::vec3(0.9f, 0.9f, 0.999f) }),
-			new Union3(
-				new Box(glm::vec3(-20.0f, 0.0f, 0.0f), glm::vec3(0.001f, 5.0f, 5.0f), { glm::vec3(0.999f, 0.999f, 0.9f) }),
-				new Box(glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(5.0f, 5.0f, 0.001f), { glm::vec3(0.9f, 0.999f, 0.999f) }),
-				new Union(
-					new Box(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(5.0f, 0.001f, 5.0f), { glm::vec3(0.999f, 0.999f, 0.9f) }),
-					new Box(glm::vec3(0.0f, -20.0f, 0.0f), glm::vec3(5.0f, 0.001f, 5.0f), { glm::vec3(0.9f, 0.999f, 0.999f) })
-				)
-			)
-		)
-	);
-}
-
-Ray RayMarcher::GetCameraRay(glm::uvec2 coord)
-{
-	glm::vec2 uv = (glm::vec2(coord) / glm::vec2(size)) * 2.0f - 1.0f;
+static const glm::vec3 BackgroundColor = glm::vec3(0.99f, 0.99f, 0.99f);
+
+RenderTarget::RenderTarget(glm::uvec2 size)
+	: size(size), pixels(size.x * size.y, glm::vec3(0.0f)), albedo(size.x * size.y), occlusion(size.x * size.y),
+	accumulation(size.x * size.y), luminanceSum(size.x * size.y), luminanceSquaredSum(size.x * size.y),
+	sampleCounts(size.x * size.y), converged(size.x * size.y), convergedCount(0),
+	cameraDirectionsFov(0.0f)
+{
+	gBuffer.Resize(size.x * size.y);
+}
+
+void RenderTarget::ResetAccumulation()
+{
+	std::fill(accumulation.begin(), accumulation.end(), glm::vec3(0.0f));
+	std::fill(luminanceSum.begin(), luminanceSum.end(), 0.0f);
+	std::fill(luminanceSquaredSum.begin(), luminanceSquaredSum.end(), 0.0f);
+	std::fill(sampleCounts.begin(), sampleCounts.end(), 0);
+	std::fill(converged.begin(), converged.end(), 0);
+	convergedCount = 0;
+}
+
+RayMarcher::RayMarcher(ThreadPool& threadPool)
+	: threadPool(threadPool)
+{
+	ResetBounceHistogram();
+	ResetMarchStatistics();
+}
+
+//Resolves the scene to render, culls it to the camera in the target's frame arena and refreshes the target's
+//direction tables
+RayMarcher::View RayMarcher::BeginView(const Scene& scene, const Camera& camera, RenderTarget& target)
+{
+	View view;
+	view.scene = &scene;
+	view.entity = settings.compileScene ? scene.GetCompiled() : scene.GetTree();
+	view.target = &target;
+
+	view.size = target.size;
+	view.aspectRatio = (float)target.size.x / (float)target.size.y;
+	view.fovFactor = 1.0f / tan(camera.fov);
+	view.pixelAngle = 2.0f / ((float)target.size.y * view.fovFactor);
+
+	view.cameraPosition = camera.position;
+	view.cameraRotation = camera.rotation;
+
+	view.stop = nullptr;
+
+	target.frameArena.Reset();
+	view.primaryScene = settings.frustumCulling ? view.entity->Cull(target.frameArena, GetCameraFrustum(view)) : view.entity;
+
+	UpdateRayDirections(view, camera.fov);
+
+	return view;
+}
+
+Ray RayMarcher::GetCameraRay(const View& view, glm::vec2 coord) const
+{
+	glm::vec2 uv = (coord / glm::vec2(view.size)) * 2.0f - 1.0f;
 
 	Ray ray = {
-		cameraPosition,
-		glm::normalize(cameraRotation * glm::vec3(uv * glm::vec2(aspectRatio, 1.0f), fovFactor))
+		view.cameraPosition,
+		glm::normalize(view.cameraRotation * glm::vec3(uv * glm::vec2(view.aspectRatio, 1.0f), view.fovFactor))
 	};
 
 	return ray;
 }
 
-glm::vec3 RayMarcher::GetNormal(glm::vec3 position, float distance)
+void RayMarcher::UpdateRayDirections(const View& view, float fov)
+{
+	RenderTarget& target = *view.target;
+	glm::uvec2 size = view.size;
+	uint32_t count = size.x * size.y;
+
+	if (target.cameraDirectionX.size() != count || target.cameraDirectionsFov != fov)
+	{
+		target.cameraDirectionX.resize(count); target.cameraDirectionY.resize(count); target.cameraDirectionZ.resize(count);
+		target.rayDirectionX.resize(count); target.rayDirectionY.resize(count); target.rayDirectionZ.resize(count);
+
+		for (uint32_t y = 0; y < size.y; y++)
+		{
+			for (uint32_t x = 0; x < size.x; x++)
+			{
+				glm::vec2 uv = ((glm::vec2(x, y) + 0.5f) / glm::vec2(size)) * 2.0f - 1.0f;
+				glm::vec3 direction = glm::normalize(glm::vec3(uv * glm::vec2(view.aspectRatio, 1.0f), view.fovFactor));
+
+				uint32_t index = y * size.x + x;
+				target.cameraDirectionX[index] = direction.x;
+				target.cameraDirectionY[index] = direction.y;
+				target.cameraDirectionZ[index] = direction.z;
+			}
+		}
+
+		target.cameraDirectionsFov = fov;
+	}
+	else if (target.rayDirectionsRotation == view.cameraRotation)
+		return;
+
+	//Rotation keeps the directions normalized
+	const glm::mat3& m = view.cameraRotation;
+	const float* cameraX = target.cameraDirectionX.data(), * cameraY = target.cameraDirectionY.data(), * cameraZ = target.cameraDirectionZ.data();
+	float* rayX = target.rayDirectionX.data(), * rayY = target.rayDirectionY.data(), * rayZ = target.rayDirectionZ.data();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float x = cameraX[i], y = cameraY[i], z = cameraZ[i];
+		rayX[i] = m[0][0] * x + m[1][0] * y + m[2][0] * z;
+		rayY[i] = m[0][1] * x + m[1][1] * y + m[2][1] * z;
+		rayZ[i] = m[0][2] * x + m[1][2] * y + m[2][2] * z;
+	}
+
+	target.rayDirectionsRotation = view.cameraRotation;
+}
+
+glm::vec3 RayMarcher::GetNormal(Entity* entity, glm::vec3 position, float distance)
 {
 	return glm::normalize((glm::vec3(
-		scene->CalculateDistanceToSurface(position + glm::vec3(0.0001f, 0.0f, 0.0f)).distance,
-		scene->CalculateDistanceToSurface(position + glm::vec3(0.0f, 0.0001f, 0.0f)).distance,
-		scene->CalculateDistanceToSurface(position + glm::vec3(0.0f, 0.0f, 0.0001f)).distance
+		entity->CalculateDistance(position + glm::vec3(0.0001f, 0.0f, 0.0f)),
+		entity->CalculateDistance(position + glm::vec3(0.0f, 0.0001f, 0.0f)),
+		entity->CalculateDistance(position + glm::vec3(0.0f, 0.0f, 0.0001f))
 	) - distance) / 0.0001f);
 }
 
-glm::vec3 RayMarcher::CastRay(glm::vec3 origin, glm::vec3 direction, float depth, uint32_t reflections)
+//Occlusion only march : distance only evaluation, no material work
+//Starts at a fixed offset to leave the surface and stops as soon as the ray is fully in shadow
+float RayMarcher::CastShadowRay(const View& view, glm::vec3 origin, glm::vec3 direction, float maxDepth, float softness)
 {
-	for (; depth < 100.0f;)
+	float shadow = 1.0f;
+	float previousDistance = FLT_MAX;
+
+	//Nothing can occlude past the scene bounds
+	float depth = 0.01f;
+	if (!ClipRay(view, origin, direction, depth, maxDepth))
 	{
-		glm::vec3 position = origin + direction * depth;
-		Surface surface = scene->CalculateDistanceToSurface(position);
+		RecordMarch(RayType::Shadow, 0, false, true);
+		return 1.0f;
+	}
+
+	uint32_t steps = 0;
+	for (; depth < maxDepth; steps++)
+	{
+		if (steps >= settings.shadowStepBudget)
+		{
+			RecordMarch(RayType::Shadow, steps, true, false);
+			return shadow;
+		}
 
-		if (surface.distance < 0.0001f)
+		float distance = view.entity->CalculateDistance(origin + direction * depth);
+		if (distance < 0.0001f)
 		{
-			if (reflections < 5)
+			RecordMarch(RayType::Shadow, steps + 1, false, false);
+			return 0.0f;
+		}
+
+		//Penumbra estimate from the closest approach between this sample and the previous one
+		float y = distance * distance / (2.0f * previousDistance);
+		float d = sqrtf(glm::max(distance * distance - y * y, 0.0f));
+		shadow = glm::min(shadow, softness * d / glm::max(depth - y, 0.0001f));
+
+		if (shadow < 0.001f)
+		{
+			RecordMarch(RayType::Shadow, steps + 1, false, false);
+			return 0.0f;
+		}
+
+		previousDistance = distance;
+		depth += distance;
+	}
+
+	RecordMarch(RayType::Shadow, steps, false, false);
+	return shadow;
+}
+
+glm::vec3 RayMarcher::GetDirectLight(const View& view, glm::vec3 position, glm::vec3 normal, float occlusion)
+{
+	glm::vec3 light = view.scene->GetAmbientLight() * occlusion;
+
+	for (const Light& source : view.scene->GetLights())
+	{
+		glm::vec3 direction = source.direction;
+		glm::vec3 color = source.color;
+		float maxDepth = 100.0f;
+
+		if (source.type == LightType::Point)
+		{
+			direction = source.position - position;
+			maxDepth = glm::length(direction);
+			direction /= maxDepth;
+			color /= maxDepth * maxDepth;
+		}
+
+		float diffuse = glm::dot(normal, direction);
+		if (diffuse <= 0.0f)
+			continue;
+
+		light += color * diffuse * CastShadowRay(view, position + normal * 0.001f, direction, maxDepth, source.softness);
+	}
+
+	return light;
+}
+
+//Compares the distance a few steps along the normal with the step length, a fully open surface returns 1
+float RayMarcher::GetAmbientOcclusion(const View& view, glm::vec3 position, glm::vec3 normal)
+{
+	float occlusion = 0.0f, maxOcclusion = 0.0f;
+	float weight = 1.0f;
+
+	for (uint32_t i = 1; i <= settings.ambientOcclusionSamples; i++)
+	{
+		float h = settings.ambientOcclusionRadius * (float)i / (float)settings.ambientOcclusionSamples;
+		float distance = view.entity->CalculateDistance(position + normal * h);
+
+		occlusion += glm::max(h - distance, 0.0f) * weight;
+		maxOcclusion += h * weight;
+		weight *= 0.8f;
+	}
+
+	return glm::clamp(1.0f - occlusion / maxOcclusion, 0.0f, 1.0f);
+}
+
+//Estimates occlusion on every other pixel in both directions, then each pixel blends the surrounding estimates
+//weighted by depth and normal similarity, pixels with no similar neighbor fall back to their own estimate
+void RayMarcher::GetTileAmbientOcclusion(const View& view, glm::uvec2 tileSize, const Hit* hits, const uint8_t* hitMask, float* occlusion)
+{
+	for (uint32_t y = 0; y < tileSize.y; y += 2)
+	{
+		for (uint32_t x = 0; x < tileSize.x; x += 2)
+		{
+			uint32_t index = y * tileSize.x + x;
+			if (hitMask[index])
+				occlusion[index] = GetAmbientOcclusion(view, hits[index].position, hits[index].normal);
+		}
+	}
+
+	for (uint32_t y = 0; y < tileSize.y; y++)
+	{
+		for (uint32_t x = 0; x < tileSize.x; x++)
+		{
+			uint32_t index = y * tileSize.x + x;
+			if (!hitMask[index] || ((x | y) & 1) == 0)
+				continue;
+
+			const Hit& hit = hits[index];
+			uint32_t x0 = x & ~1u, y0 = y & ~1u;
+
+			float sum = 0.0f, weightSum = 0.0f;
+			for (uint32_t sy = y0; sy <= y0 + 2 && sy < tileSize.y; sy += 2)
 			{
-				glm::vec3 normal = GetNormal(position, surface.distance);
-				direction = glm::reflect(direction, normal);
+				for (uint32_t sx = x0; sx <= x0 + 2 && sx < tileSize.x; sx += 2)
+				{
+					uint32_t sample = sy * tileSize.x + sx;
+					if (!hitMask[sample])
+						continue;
+
+					float weight = (1.0f - fabsf((float)sx - (float)x) * 0.5f) * (1.0f - fabsf((float)sy - (float)y) * 0.5f);
+					weight *= glm::step(fabsf(hits[sample].depth - hit.depth), hit.depth * 0.05f);
+					weight *= glm::step(0.9f, glm::dot(hits[sample].normal, hit.normal));
 
-				return surface.material.color * CastRay(position, direction, 0.01f, reflections + 1);
+					sum += occlusion[sample] * weight;
+					weightSum += weight;
+				}
 			}
-			else
-				return surface.material.color;
+
+			occlusion[index] = weightSum > 0.001f ? sum / weightSum : GetAmbientOcclusion(view, hit.position, hit.normal);
+		}
+	}
+}
+
+//Slab test against the scene bounds
+bool RayMarcher::ClipRay(const View& view, glm::vec3 origin, glm::vec3 direction, float& near, float& far) const
+{
+	const Bounds& bounds = view.scene->GetBounds();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		//Parallel to the slab the origin alone decides, dividing would give 0/0 with the origin on a plane
+		if (direction[axis] == 0.0f)
+		{
+			if (origin[axis] < bounds.min[axis] || origin[axis] > bounds.max[axis])
+				return false;
+			continue;
 		}
 
-		depth += surface.distance;
+		float inverse = 1.0f / direction[axis];
+		float t1 = (bounds.min[axis] - origin[axis]) * inverse;
+		float t2 = (bounds.max[axis] - origin[axis]) * inverse;
+		near = glm::max(near, glm::min(t1, t2));
+		far = glm::min(far, glm::max(t1, t2));
 	}
 
-	return glm::vec3(0.99f, 0.99f, 0.99f);
+	return near <= far;
 }
 
-void RayMarcher::RenderBatch(glm::uvec2 topLeft, glm::uvec2 bottomRight)
+//Outside the surface the ray takes the sphere tracing step, which is always safe, when the secant through the last two
+//samples puts the root further but within twice the distance it is sampled first and only taken if that sample is
+//inside, bracketing the root, or its free ball reaches back to the safe step, so no thin feature can be jumped over
+//Once bracketed regula falsi alternates with bisection and the outside end of the bracket is returned, a point inside
+//a thin wall can sit where its gradient vanishes and give no normal
+//At most maxSteps distance evaluations are made, the caller passes what is left of its step budget
+uint32_t RayMarcher::RefineHit(Entity* entity, glm::vec3 origin, glm::vec3 direction, float previousDepth, float previousDistance, float& depth, float& distance, uint32_t maxSteps)
 {
-	glm::uvec2 coord;
-	for (coord.x = topLeft.x; coord.x < bottomRight.x; coord.x++)
+	//Last sample known to be outside, the previous march step
+	float outsideDepth = previousDepth, outsideDistance = previousDistance;
+
+	uint32_t steps = 0;
+	for (; steps < maxSteps; steps++)
+	{
+		float next;
+		if (distance >= 0.0f)
+		{
+			if (distance < settings.hitEpsilon || outsideDistance <= distance)
+				break;
+
+			float secant = distance * (depth - outsideDepth) / (outsideDistance - distance);
+			outsideDepth = depth;
+			outsideDistance = distance;
+
+			next = depth + distance;
+			if (secant > distance && secant <= distance * 2.0f && steps + 1 < maxSteps)
+			{
+				float secantDepth = depth + secant;
+				float secantDistance = entity->CalculateDistance(origin + direction * secantDepth);
+				steps++;
+
+				if (secantDistance < 0.0f || secantDepth - secantDistance <= next)
+				{
+					depth = secantDepth;
+					distance = secantDistance;
+					continue;
+				}
+			}
+		}
+		else
+		{
+			if (-distance < settings.hitEpsilon || outsideDistance < settings.hitEpsilon)
+				break;
+
+			next = (steps & 1) ? (outsideDepth + depth) * 0.5f :
+				outsideDepth + outsideDistance * (depth - outsideDepth) / (outsideDistance - distance);
+		}
+
+		float nextDistance = entity->CalculateDistance(origin + direction * next);
+		if (distance < 0.0f && nextDistance >= 0.0f)
+		{
+			outsideDepth = next;
+			outsideDistance = nextDistance;
+		}
+		else
+		{
+			depth = next;
+			distance = nextDistance;
+		}
+	}
+
+	if (distance < 0.0f)
+	{
+		depth = outsideDepth;
+		distance = outsideDistance;
+	}
+
+	return steps;
+}
+
+bool RayMarcher::MarchRay(const View& view, glm::vec3 origin, glm::vec3 direction, float depth, RayType type, Hit& hit, Entity* entity,
+	float maxDepth, std::vector<glm::vec2>* trace)
+{
+	bool primary = type == RayType::Primary;
+	if (!entity)
+		entity = primary ? view.primaryScene : view.entity;
+
+	if (!entity || !ClipRay(view, origin, direction, depth, maxDepth))
 	{
-		for (coord.y = topLeft.y; coord.y < bottomRight.y; coord.y++)
+		RecordMarch(type, 0, false, true);
+		return false;
+	}
+
+	float footprint = (primary ? settings.primaryHitFootprint : settings.secondaryHitFootprint) * view.pixelAngle;
+	uint32_t budget = primary ? settings.primaryStepBudget : settings.secondaryStepBudget;
+
+	float previousDepth = depth, previousDistance = FLT_MAX;
+	uint32_t steps = 0;
+	bool budgetHit = false;
+	for (; depth < maxDepth;)
+	{
+		//An abandoned render gives up on its rays, its tiles are not used
+		if ((steps & 63) == 0 && view.stop && view.stop->load(std::memory_order_relaxed))
+			break;
+
+		glm::vec3 position = origin + direction * depth;
+		float distance = entity->CalculateDistance(position);
+		steps++;
+
+		if (trace && distance > 0.0f)
+			trace->push_back(glm::vec2(depth, distance));
+
+		float threshold = glm::max(settings.hitEpsilon, footprint * depth);
+		bool approaching = distance < previousDistance && previousDistance < FLT_MAX;
+		if (steps < budget && approaching && settings.hitRefinementSteps > 0 && distance < threshold * settings.hitRefinementFactor)
+		{
+			//Refinement samples count against the budget so no ray takes more than it
+			steps += RefineHit(entity, origin, direction, previousDepth, previousDistance, depth, distance,
+				glm::min(settings.hitRefinementSteps, budget - steps));
+			position = origin + direction * depth;
+			threshold = glm::max(settings.hitEpsilon, footprint * depth);
+		}
+		budgetHit = steps >= budget;
+
+		//Out of steps in mid air is a miss, shading it would put a surface where there is none
+		if (budgetHit && distance >= threshold * settings.budgetHitFactor)
+			break;
+
+		if (distance < threshold || budgetHit)
 		{
-			Ray ray = GetCameraRay(coord);
+			RecordMarch(type, steps, budgetHit, false);
 
-			glm::vec3* pixel = &pixels[coord.y * size.x + coord.x];
-			*pixel = CastRay(ray.origin, ray.direction);
+			hit.position = position;
+			hit.normal = GetNormal(entity, position, distance);
+			hit.depth = depth;
+			hit.material = entity->CalculateMaterial(position, view.scene->GetMaterials());
+			hit.materialId = entity->CalculateDistanceToSurface(position).material;
+			return true;
 		}
+
+		previousDepth = depth;
+		previousDistance = distance;
+		depth += distance;
 	}
+
+	RecordMarch(type, steps, budgetHit, false);
+	return false;
 }
 
-glm::vec3* RayMarcher::Render(uint32_t batchSize)
+//The free balls along the neighbor's ray cover this ray over depth +- (distance - depth * spread) as long as the
+//intervals chain without a gap
+float RayMarcher::GetCoherentStart(const std::vector<glm::vec2>& trace, float spread, float start) const
 {
-	glm::uvec2 batchCount = glm::uvec2(glm::ceil((float)size.x / (float)batchSize), glm::ceil((float)size.y / (float)batchSize));
+	float depth = start;
+	for (glm::vec2 sample : trace)
+	{
+		float radius = sample.y - sample.x * spread;
+		if (sample.x - radius > depth)
+			break;
+
+		depth = glm::max(depth, sample.x + radius);
+	}
+
+	return depth;
+}
 
-	glm::uvec2 coord = glm::uvec2(0, 0);
-	glm::uvec2 coord2 = glm::uvec2(0, 0);
+//Follows the mirror reflections from a primary hit iteratively, throughput holds the product of colors and
+//reflectivities so far and each hit adds its non reflected part weighted by it
+glm::vec3 RayMarcher::ShadeHit(const View& view, const Hit& primaryHit, glm::vec3 direction, float occlusion)
+{
+	glm::vec3 radiance = glm::vec3(0.0f);
+	glm::vec3 throughput = glm::vec3(1.0f);
 
-	for (uint32_t x = 0; x < batchCount.x; x++)
+	Hit hit = primaryHit;
+	uint32_t bounces = 1;
+	for (;; bounces++)
 	{
-		coord.y = 0;
-		coord2.x = glm::min(coord.x + batchSize, size.x);
+		throughput *= hit.material.color;
 
-		for (uint32_t y = 0; y < batchCount.y; y++)
+		float reflectivity = bounces <= settings.maxReflections ? hit.material.reflectivity : 0.0f;
+		if (reflectivity < 1.0f)
 		{
-			coord2.y = glm::min(coord.y + batchSize, size.y);
+			glm::vec3 light = view.scene->GetLights().empty() ? glm::vec3(occlusion) : GetDirectLight(view, hit.position, hit.normal, occlusion);
+			radiance += throughput * light * (1.0f - reflectivity);
+		}
 
-			std::async(std::launch::async, std::bind(&RayMarcher::RenderBatch, this, coord, coord2));
+		throughput *= reflectivity;
+		if (glm::max(throughput.x, glm::max(throughput.y, throughput.z)) < settings.throughputThreshold)
+			break;
 
-			coord.y = coord2.y;
+		direction = glm::reflect(direction, hit.normal);
+		occlusion = 1.0f;
+
+		if (!MarchRay(view, hit.position, direction, 0.01f, RayType::Secondary, hit))
+		{
+			radiance += throughput * BackgroundColor;
+			break;
 		}
+	}
 
-		coord.x = coord2.x;
+	RecordBounces(bounces);
+	return radiance;
+}
+
+glm::vec3 RayMarcher::CastRay(const View& view, glm::vec3 origin, glm::vec3 direction)
+{
+	Hit hit;
+	if (MarchRay(view, origin, direction, 0.0f, RayType::Primary, hit))
+		return ShadeHit(view, hit, direction, 1.0f);
+
+	RecordBounces(0);
+	return BackgroundColor;
+}
+
+std::vector<uint64_t> RayMarcher::GetBounceHistogram() const
+{
+	std::vector<uint64_t> histogram(MAX_BOUNCES + 1);
+	for (uint32_t i = 0; i <= MAX_BOUNCES; i++)
+		histogram[i] = bounceHistogram[i];
+
+	return histogram;
+}
+
+void RayMarcher::RecordMarch(RayType type, uint32_t steps, bool budgetHit, bool boundsMiss)
+{
+	rayCounts[(uint32_t)type].fetch_add(1, std::memory_order_relaxed);
+	stepCounts[(uint32_t)type].fetch_add(steps, std::memory_order_relaxed);
+	if (budgetHit)
+		budgetHits[(uint32_t)type].fetch_add(1, std::memory_order_relaxed);
+	if (boundsMiss)
+		boundsMisses[(uint32_t)type].fetch_add(1, std::memory_order_relaxed);
+}
+
+MarchStatistics RayMarcher::GetMarchStatistics() const
+{
+	MarchStatistics statistics;
+	for (uint32_t i = 0; i < RAY_TYPE_COUNT; i++)
+	{
+		statistics.rays[i] = rayCounts[i];
+		statistics.steps[i] = stepCounts[i];
+		statistics.budgetHits[i] = budgetHits[i];
+		statistics.boundsMisses[i] = boundsMisses[i];
 	}
+	return statistics;
+}
 
-	mutex.lock();
-	mutex.unlock();
+void RayMarcher::ResetMarchStatistics()
+{
+	for (uint32_t i = 0; i < RAY_TYPE_COUNT; i++)
+	{
+		rayCounts[i] = 0;
+		stepCounts[i] = 0;
+		budgetHits[i] = 0;
+		boundsMisses[i] = 0;
+	}
+}
 
-	return pixels;
+void RayMarcher::ResetBounceHistogram()
+{
+	for (uint32_t i = 0; i <= MAX_BOUNCES; i++)
+		bounceHistogram[i] = 0;
 }
 
-std::future<void> RayMarcher::AsyncRender(std::function<void(glm::vec3*, glm::uvec2)> update, uint32_t batchSize)
+static const glm::vec2 grid2x2Pattern[] = {
+	glm::vec2(-0.25f, -0.25f), glm::vec2(0.25f, -0.25f), glm::vec2(-0.25f, 0.25f), glm::vec2(0.25f, 0.25f),
+};
+static const glm::vec2 rotatedGrid4Pattern[] = {
+	glm::vec2(-0.125f, -0.375f), glm::vec2(0.375f, -0.125f), glm::vec2(0.125f, 0.375f), glm::vec2(-0.375f, 0.125f),
+};
+static const glm::vec2 queens8Pattern[] = {
+	glm::vec2(-0.4375f, -0.0625f), glm::vec2(-0.3125f, 0.3125f), glm::vec2(-0.1875f, -0.3125f), glm::vec2(-0.0625f, 0.1875f),
+	glm::vec2(0.0625f, -0.4375f), glm::vec2(0.1875f, 0.4375f), glm::vec2(0.3125f, -0.1875f), glm::vec2(0.4375f, 0.0625f),
+};
+
+bool RayMarcher::IsEdge(const RenderTarget& target, uint32_t pixel, uint32_t pixel2)
 {
-	return std::async(std::launch::async,
-		[this, batchSize, update]() {
-			glm::uvec2 batchCount = glm::uvec2(glm::ceil((float)size.x / (float)batchSize), glm::ceil((float)size.y / (float)batchSize));
+	const GBuffer& gBuffer = target.gBuffer;
+	bool isHit = gBuffer.material[pixel] != BACKGROUND_MATERIAL;
+	bool isHit2 = gBuffer.material[pixel2] != BACKGROUND_MATERIAL;
+	if (isHit != isHit2)
+		return true;
 
-			glm::uvec2 coord = glm::uvec2(0, 0);
-			glm::uvec2 coord2 = glm::uvec2(0, 0);
+	if (isHit)
+	{
+		float depth = gBuffer.depth[pixel], depth2 = gBuffer.depth[pixel2];
+		if (fabsf(depth - depth2) > glm::min(depth, depth2) * settings.antiAliasingDepthThreshold ||
+			glm::dot(gBuffer.normal[pixel], gBuffer.normal[pixel2]) < settings.antiAliasingNormalThreshold ||
+			target.albedo[pixel] != target.albedo[pixel2])
+			return true;
+	}
 
-			for (uint32_t x = 0; x < batchCount.x; x++)
+	const glm::vec3 luminance = glm::vec3(0.2126f, 0.7152f, 0.0722f);
+	return fabsf(glm::dot(target.pixels[pixel] - target.pixels[pixel2], luminance)) > settings.antiAliasingContrastThreshold;
+}
+
+//Flags pixels against their four neighbors inside the region, then replaces flagged pixels with the average of the
+//one-sample result and the sample pattern
+//Runs once every tile of the region is shaded, so edges on tile borders are found like any other
+void RayMarcher::AntiAlias(const View& view, glm::uvec2 regionMin, glm::uvec2 regionMax)
+{
+	RenderTarget& target = *view.target;
+
+	const glm::vec2* pattern = rotatedGrid4Pattern;
+	uint32_t patternSize = 4;
+	switch (settings.antiAliasingPattern)
+	{
+	case SamplePattern::Grid2x2:
+		pattern = grid2x2Pattern;
+		break;
+	case SamplePattern::Queens8:
+		pattern = queens8Pattern;
+		patternSize = 8;
+		break;
+	default:
+		break;
+	}
+
+	glm::uvec2 regionSize = regionMax - regionMin;
+	std::vector<uint8_t> edges(regionSize.x * regionSize.y, 0);
+
+	//Every pixel only writes its own flag, and nothing is written to the image until all flags are set
+	threadPool.ParallelFor(regionSize.y, [this, &target, &edges, regionMin, regionMax, regionSize](uint32_t row) {
+		uint32_t y = regionMin.y + row;
+		for (uint32_t x = regionMin.x; x < regionMax.x; x++)
+		{
+			uint32_t pixel = y * target.size.x + x;
+			edges[row * regionSize.x + x - regionMin.x] =
+				(x > regionMin.x && IsEdge(target, pixel, pixel - 1)) ||
+				(x + 1 < regionMax.x && IsEdge(target, pixel, pixel + 1)) ||
+				(y > regionMin.y && IsEdge(target, pixel, pixel - target.size.x)) ||
+				(y + 1 < regionMax.y && IsEdge(target, pixel, pixel + target.size.x));
+		}
+	});
+
+	threadPool.ParallelFor(regionSize.y, [this, &view, &target, &edges, regionMin, regionMax, regionSize, pattern, patternSize](uint32_t row) {
+		uint32_t y = regionMin.y + row;
+		for (uint32_t x = regionMin.x; x < regionMax.x; x++)
+		{
+			if (!edges[row * regionSize.x + x - regionMin.x])
+				continue;
+
+			uint32_t pixel = y * target.size.x + x;
+			glm::vec2 coord = glm::vec2(x, y) + 0.5f;
+			glm::vec3 color = target.pixels[pixel];
+
+			for (uint32_t i = 0; i < patternSize; i++)
 			{
-				coord.y = 0;
-				coord2.x = glm::min(coord.x + batchSize, size.x);
+				Ray ray = GetCameraRay(view, coord + pattern[i]);
+
+				Hit hit;
+				if (MarchRay(view, ray.origin, ray.direction, 0.0f, RayType::Primary, hit))
+					color += ShadeHit(view, hit, ray.direction, target.occlusion[pixel]);
+				else
+					color += BackgroundColor;
+			}
+
+			target.pixels[pixel] = color / (float)(patternSize + 1);
+		}
+	});
+}
+
+//PCG hash, used to seed and advance the per pixel random sequence
+static uint32_t Hash(uint32_t value)
+{
+	uint32_t state = value * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+static float Random(uint32_t& seed)
+{
+	seed = Hash(seed);
+	return (float)(seed >> 8) * (1.0f / 16777216.0f);
+}
 
-				for (uint32_t y = 0; y < batchCount.y; y++)
+static glm::vec3 SampleCosineHemisphere(glm::vec3 normal, uint32_t& seed)
+{
+	float phi = glm::two_pi<float>() * Random(seed);
+	float r2 = Random(seed);
+	float r = sqrtf(r2);
+
+	glm::vec3 tangent = glm::normalize(glm::cross(fabsf(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+	glm::vec3 bitangent = glm::cross(normal, tangent);
+
+	return glm::normalize(tangent * (cosf(phi) * r) + bitangent * (sinf(phi) * r) + normal * sqrtf(1.0f - r2));
+}
+
+//Stochastic counterpart of ShadeHit : each bounce is either a mirror reflection (with probability reflectivity)
+//or a cosine sampled diffuse bounce with next event estimation, the background acts as a uniform sky
+glm::vec3 RayMarcher::TracePath(const View& view, glm::vec3 origin, glm::vec3 direction, uint32_t& seed, Hit* primaryHit)
+{
+	glm::vec3 radiance = glm::vec3(0.0f);
+	glm::vec3 throughput = glm::vec3(1.0f);
+
+	float depth = 0.0f;
+	uint32_t bounces = 0;
+	for (; bounces < settings.pathTracingMaxBounces; bounces++)
+	{
+		Hit hit;
+		if (!MarchRay(view, origin, direction, depth, bounces == 0 ? RayType::Primary : RayType::Secondary, hit))
+		{
+			radiance += throughput * BackgroundColor;
+			break;
+		}
+
+		if (bounces == 0 && primaryHit)
+			*primaryHit = hit;
+
+		throughput *= hit.material.color;
+
+		//Russian roulette, surviving paths are reweighted so the estimate stays unbiased, a hard throughput cutoff
+		//would drop their contribution instead
+		if (bounces >= settings.russianRouletteBounce)
+		{
+			float maxThroughput = glm::max(throughput.x, glm::max(throughput.y, throughput.z));
+			float survival = glm::min(maxThroughput, 0.95f);
+			if (Random(seed) >= survival)
+			{
+				bounces++;
+				break;
+			}
+
+			throughput /= survival;
+		}
+
+		if (Random(seed) < hit.material.reflectivity)
+			direction = glm::reflect(direction, hit.normal);
+		else
+		{
+			radiance += throughput * GetDirectLight(view, hit.position, hit.normal, 0.0f);
+			direction = SampleCosineHemisphere(hit.normal, seed);
+		}
+
+		origin = hit.position;
+		depth = 0.01f;
+	}
+
+	RecordBounces(bounces);
+	return radiance;
+}
+
+void RayMarcher::RenderBatchPathTraced(const View& view, glm::uvec2 topLeft, glm::uvec2 bottomRight)
+{
+	RenderTarget& target = *view.target;
+
+	glm::uvec2 coord;
+	for (coord.y = topLeft.y; coord.y < bottomRight.y; coord.y++)
+	{
+		for (coord.x = topLeft.x; coord.x < bottomRight.x; coord.x++)
+		{
+			uint32_t index = coord.y * view.size.x + coord.x;
+			if (target.converged[index])
+			{
+				target.pixels[index] = target.accumulation[index] / (float)target.sampleCounts[index];
+				continue;
+			}
+
+			for (uint32_t i = 0; i < settings.pathTracingSamplesPerPass; i++)
+			{
+				uint32_t seed = Hash(index ^ Hash(target.sampleCounts[index]));
+				Ray ray = GetCameraRay(view, glm::vec2(coord) + glm::vec2(Random(seed), Random(seed)));
+
+				//The first sample of a pixel provides its guides
+				Hit primaryHit;
+				primaryHit.depth = -1.0f;
+
+				glm::vec3 color = TracePath(view, ray.origin, ray.direction, seed, target.sampleCounts[index] == 0 ? &primaryHit : nullptr);
+
+				if (target.sampleCounts[index] == 0)
 				{
-					coord2.y = glm::min(coord.y + batchSize, size.y);
+					if (primaryHit.depth >= 0.0f)
+						target.gBuffer.Set(index, primaryHit.depth, primaryHit.normal, primaryHit.materialId);
+					else
+						target.gBuffer.SetBackground(index);
+				}
+
+				float luminance = glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+
+				target.accumulation[index] += color;
+				target.luminanceSum[index] += luminance;
+				target.luminanceSquaredSum[index] += luminance * luminance;
+				target.sampleCounts[index]++;
+			}
+
+			float count = (float)target.sampleCounts[index];
+			target.pixels[index] = target.accumulation[index] / count;
 
-					printf("%i %i\n", x, y);
+			float mean = target.luminanceSum[index] / count;
+			float variance = glm::max(target.luminanceSquaredSum[index] / count - mean * mean, 0.0f);
+			float error = sqrtf(variance / count);
 
-					RayMarcher::RenderBatch(coord, coord2);
+			if ((target.sampleCounts[index] >= settings.pathTracingMinSamples && error <= settings.pathTracingErrorThreshold * glm::max(mean, 0.01f)) ||
+				target.sampleCounts[index] >= settings.pathTracingMaxSamples)
+			{
+				target.converged[index] = 1;
+				target.convergedCount++;
+			}
+		}
+	}
+}
 
-					update(pixels, size);
+void RayMarcher::RenderBatch(const View& view, glm::uvec2 topLeft, glm::uvec2 bottomRight)
+{
+	RenderTarget& target = *view.target;
 
-					coord.y = coord2.y;
+	if (settings.mode == RenderMode::PathTracing)
+	{
+		RenderBatchPathTraced(view, topLeft, bottomRight);
+		return;
+	}
+
+	glm::uvec2 tileSize = bottomRight - topLeft;
+	uint32_t count = tileSize.x * tileSize.y;
+
+	std::vector<Hit> hits(count);
+	std::vector<uint8_t> hitMask(count);
+	std::vector<glm::vec3> directions(count);
+	std::vector<float> occlusion(count, 1.0f);
+
+	std::vector<RegionTape> tapes(count, { view.primaryScene, 0.0f, 100.0f });
+	SceneArena tapeArena(4 * 1024);
+	if (settings.quadtree && view.primaryScene)
+		ClassifyRegion(view, tapeArena, tapes[0], topLeft, bottomRight, topLeft, tileSize, tapes.data());
+
+	//March traces of the previous pixel and of the first pixel of the previous row, empty until those are marched
+	std::vector<glm::vec2> trace, neighborTrace, rowTrace;
+	glm::vec3 neighborDirection(0.0f), rowDirection(0.0f);
+
+	//Primary hits first, so the tile passes can look at neighbors
+	glm::uvec2 coord;
+	for (coord.y = topLeft.y; coord.y < bottomRight.y; coord.y++)
+	{
+		for (coord.x = topLeft.x; coord.x < bottomRight.x; coord.x++)
+		{
+			uint32_t index = (coord.y - topLeft.y) * tileSize.x + (coord.x - topLeft.x);
+
+			Ray ray = GetPixelRay(view, coord);
+			directions[index] = ray.direction;
+
+			const RegionTape& tape = tapes[index];
+			trace.clear();
+			if (tape.entity)
+			{
+				float start = tape.near;
+				bool firstColumn = coord.x == topLeft.x;
+				const std::vector<glm::vec2>& previousTrace = firstColumn ? rowTrace : neighborTrace;
+				if (settings.coherentStartDepths && !previousTrace.empty())
+				{
+					start = GetCoherentStart(previousTrace, glm::length(ray.direction - (firstColumn ? rowDirection : neighborDirection)), start);
+
+					if (start > tape.near)
+					{
+						stepCounts[(uint32_t)RayType::Primary].fetch_add(1, std::memory_order_relaxed);
+						if (tape.entity->CalculateDistance(ray.origin + ray.direction * start) < 0.0f)
+							start = tape.near;
+					}
 				}
 
-				coord.x = coord2.x;
+				hitMask[index] = MarchRay(view, ray.origin, ray.direction, start, RayType::Primary, hits[index], tape.entity, tape.far,
+					settings.coherentStartDepths ? &trace : nullptr);
+			}
+			else
+			{
+				RecordMarch(RayType::Primary, 0, false, true);
+				hitMask[index] = false;
+			}
+
+			if (coord.x == topLeft.x)
+			{
+				rowTrace = trace;
+				rowDirection = ray.direction;
 			}
+			neighborTrace.swap(trace);
+			neighborDirection = ray.direction;
 		}
-	);
+	}
+
+	if (settings.ambientOcclusion)
+		GetTileAmbientOcclusion(view, tileSize, hits.data(), hitMask.data(), occlusion.data());
+
+	for (coord.y = topLeft.y; coord.y < bottomRight.y; coord.y++)
+	{
+		for (coord.x = topLeft.x; coord.x < bottomRight.x; coord.x++)
+		{
+			uint32_t index = (coord.y - topLeft.y) * tileSize.x + (coord.x - topLeft.x);
+
+			uint32_t pixelIndex = coord.y * view.size.x + coord.x;
+			if (hitMask[index])
+			{
+				target.pixels[pixelIndex] = ShadeHit(view, hits[index], directions[index], occlusion[index]);
+				target.gBuffer.Set(pixelIndex, hits[index].depth, hits[index].normal, hits[index].materialId);
+				target.albedo[pixelIndex] = hits[index].material.color;
+			}
+			else
+			{
+				target.pixels[pixelIndex] = BackgroundColor;
+				target.gBuffer.SetBackground(pixelIndex);
+				target.albedo[pixelIndex] = BackgroundColor;
+				RecordBounces(0);
+			}
+			target.occlusion[pixelIndex] = occlusion[index];
+		}
+	}
+}
+
+//Box around the part of the frustum through the pixel rectangle between the near and far depths
+//Rays between the corner rays lie in the hull of the corner segments, up to a bulge of at most far * (1 - cos) where
+//cos is the smallest cosine between a corner ray and the central one
+Bounds RayMarcher::GetRegionBounds(const View& view, glm::vec2 regionMin, glm::vec2 regionMax, float near, float far) const
+{
+	glm::vec3 corners[4] = {
+		GetCameraRay(view, regionMin).direction,
+		GetCameraRay(view, glm::vec2(regionMax.x, regionMin.y)).direction,
+		GetCameraRay(view, regionMax).direction,
+		GetCameraRay(view, glm::vec2(regionMin.x, regionMax.y)).direction,
+	};
+	glm::vec3 axis = glm::normalize(corners[0] + corners[1] + corners[2] + corners[3]);
+
+	Bounds bounds = { glm::vec3(BOUNDS_INFINITY), glm::vec3(-BOUNDS_INFINITY) };
+	float cosine = 1.0f;
+	for (glm::vec3 corner : corners)
+	{
+		bounds = bounds.Union({ glm::min(corner * near, corner * far), glm::max(corner * near, corner * far) });
+		cosine = glm::min(cosine, glm::dot(corner, axis));
+	}
+
+	bounds = bounds.Inflate(glm::vec3(far * (1.0f - cosine)));
+	return { bounds.min + view.cameraPosition, bounds.max + view.cameraPosition };
 }
 
-void RayMarcher::Wait()
+//Slices the region's depth range quadratically (thinner near the camera, where the slices are narrow anyway),
+//prunes the tape to the occupied slices and recurses into the quadrants until the leaf size
+//A slice is empty when no point in it is within the hit threshold of its far end, so the march could not stop there
+void RayMarcher::ClassifyRegion(const View& view, SceneArena& tapeArena, RegionTape tape, glm::uvec2 regionMin, glm::uvec2 regionMax,
+	glm::uvec2 topLeft, glm::uvec2 tileSize, RegionTape* tapes)
 {
-	mutex.lock();
-	mutex.unlock();
-}
\ No newline at end of file
+	//The rectangle's edges are half a pixel outside the rays through the pixel centers on its border
+	glm::vec2 pixelMin = glm::vec2(regionMin), pixelMax = glm::vec2(regionMax);
+	float footprint = settings.primaryHitFootprint * view.pixelAngle;
+
+	Bounds occupied = { glm::vec3(BOUNDS_INFINITY), glm::vec3(-BOUNDS_INFINITY) };
+	float near = tape.far, far = tape.near;
+
+	uint32_t sliceCount = glm::max(settings.quadtreeDepthSlices, 1u);
+	for (uint32_t i = 0; i < sliceCount; i++)
+	{
+		float t0 = (float)i / (float)sliceCount, t1 = (float)(i + 1) / (float)sliceCount;
+		float sliceNear = glm::mix(tape.near, tape.far, t0 * t0);
+		float sliceFar = glm::mix(tape.near, tape.far, t1 * t1);
+
+		Bounds slice = GetRegionBounds(view, pixelMin, pixelMax, sliceNear, sliceFar).Intersect(view.scene->GetBounds());
+		if (slice.IsEmpty() || tape.entity->CalculateDistanceInterval(slice).min > glm::max(settings.hitEpsilon, footprint * sliceFar))
+			continue;
+
+		occupied = occupied.Union(slice);
+		near = glm::min(near, sliceNear);
+		far = sliceFar;
+	}
+
+	RegionTape region = { nullptr, near, far };
+	if (!occupied.IsEmpty())
+	{
+		//Margin for the normal estimate around hits on the border
+		region.entity = tape.entity->Prune(tapeArena, occupied.Inflate(glm::vec3(0.01f)));
+	}
+
+	glm::uvec2 extent = regionMax - regionMin;
+	if (region.entity && glm::max(extent.x, extent.y) > settings.quadtreeLeafSize)
+	{
+		glm::uvec2 middle = regionMin + (extent + 1u) / 2u;
+		glm::uvec2 corners[3] = { regionMin, middle, regionMax };
+		for (uint32_t y = 0; y < 2; y++)
+		{
+			for (uint32_t x = 0; x < 2; x++)
+			{
+				glm::uvec2 childMin = glm::uvec2(corners[x].x, corners[y].y);
+				glm::uvec2 childMax = glm::uvec2(corners[x + 1].x, corners[y + 1].y);
+				if (childMin.x < childMax.x && childMin.y < childMax.y)
+					ClassifyRegion(view, tapeArena, region, childMin, childMax, topLeft, tileSize, tapes);
+			}
+		}
+		return;
+	}
+
+	for (uint32_t y = regionMin.y; y < regionMax.y; y++)
+	{
+		for (uint32_t x = regionMin.x; x < regionMax.x; x++)
+			tapes[(y - topLeft.y) * tileSize.x + (x - topLeft.x)] = region;
+	}
+}
+
+//Corner rays of the image, widened by a pixel for the anti-aliasing and path tracing jitter
+Frustum RayMarcher::GetCameraFrustum(const View& view) const
+{
+	glm::vec2 extent = 1.0f + 2.0f / glm::vec2(view.size);
+	glm::vec3 corners[4];
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		glm::vec2 uv = glm::vec2(i == 0 || i == 3 ? -extent.x : extent.x, i < 2 ? -extent.y : extent.y);
+		corners[i] = view.cameraRotation * glm::vec3(uv * glm::vec2(view.aspectRatio, 1.0f), view.fovFactor);
+	}
+
+	//Corners go around the image, each side plane holds two neighbors and the camera
+	glm::vec3 forward = view.cameraRotation * glm::vec3(0.0f, 0.0f, 1.0f);
+
+	Frustum frustum;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		glm::vec3 normal = glm::normalize(glm::cross(corners[i], corners[(i + 1) % 4]));
+		if (glm::dot(normal, forward) < 0.0f)
+			normal = -normal;
+
+		frustum.planes[i] = glm::vec4(normal, -glm::dot(normal, view.cameraPosition));
+	}
+
+	return frustum;
+}
+
+glm::vec3* RayMarcher::Render(const Scene& scene, const Camera& camera, RenderTarget& target, uint32_t batchSize)
+{
+	return RenderRegion(scene, camera, target, glm::uvec2(0, 0), target.size, batchSize);
+}
+
+glm::vec3* RayMarcher::RenderRegion(const Scene& scene, const Camera& camera, RenderTarget& target, glm::uvec2 regionMin, glm::uvec2 regionMax,
+	uint32_t batchSize)
+{
+	View view = BeginView(scene, camera, target);
+	glm::uvec2 size = view.size;
+
+	regionMax = glm::min(regionMax, size);
+	if (regionMin.x >= regionMax.x || regionMin.y >= regionMax.y)
+		return target.pixels.data();
+
+	//Tiles stay on the grid of a whole frame, so a region renders exactly what the full frame would
+	glm::uvec2 firstBatch = regionMin / batchSize;
+	glm::uvec2 batchCount = (regionMax + batchSize - 1u) / batchSize - firstBatch;
+
+	threadPool.ParallelFor(batchCount.x * batchCount.y, [this, &view, size, batchSize, batchCount, firstBatch](uint32_t batch) {
+		glm::uvec2 coord = (firstBatch + glm::uvec2(batch % batchCount.x, batch / batchCount.x)) * batchSize;
+		glm::uvec2 coord2 = glm::min(coord + batchSize, size);
+
+		RenderBatch(view, coord, coord2);
+	});
+
+	if (settings.mode == RenderMode::Deterministic && settings.antiAliasing)
+		AntiAlias(view, firstBatch * batchSize, glm::min((firstBatch + batchCount) * batchSize, size));
+
+	//The guides outside a partial region belong to another frame
+	if (settings.denoise && regionMin == glm::uvec2(0, 0) && regionMax == size)
+		DenoiseAtrous(threadPool, size, target.pixels.data(), target.gBuffer, settings.denoiseSettings);
+
+	return target.pixels.data();
+}
+
+glm::vec3* RayMarcher::Render(SceneVersions& scene, const Camera& camera, RenderTarget& target, uint32_t batchSize)
+{
+	SceneVersions::Snapshot snapshot = scene.Acquire();
+	return Render(*snapshot, camera, target, batchSize);
+}
+
+std::unique_ptr<RenderHandle> RayMarcher::AsyncRender(const Scene& scene, const Camera& camera, RenderTarget& target,
+	RenderUpdateFunction update, uint32_t batchSize, std::chrono::steady_clock::duration timeLimit)
+{
+	std::unique_ptr<RenderHandle> handle(new RenderHandle(*this, &scene, nullptr, camera, target, update, batchSize, timeLimit));
+	handle->Restart(camera);
+	return handle;
+}
+
+std::unique_ptr<RenderHandle> RayMarcher::AsyncRender(SceneVersions& scene, const Camera& camera, RenderTarget& target,
+	RenderUpdateFunction update, uint32_t batchSize, std::chrono::steady_clock::duration timeLimit)
+{
+	std::unique_ptr<RenderHandle> handle(new RenderHandle(*this, nullptr, &scene, camera, target, update, batchSize, timeLimit));
+	handle->Restart(camera);
+	return handle;
+}
+
+void RayMarcher::RunAsyncRender(RenderHandle& handle)
+{
+	for (;;)
+	{
+		std::unique_lock<std::mutex> cameraLock(handle.mutex);
+		//Cancelled before the frame started, keeping the flag set stops the render without tracing a tile
+		if (handle.cancelled)
+		{
+			handle.status = RenderStatus::Cancelled;
+			handle.running = false;
+			handle.finished.notify_all();
+			return;
+		}
+
+		Camera camera = handle.camera;
+		handle.restart = false;
+		handle.stop = handle.cancelled;
+		cameraLock.unlock();
+
+		std::unique_ptr<SceneVersions::Snapshot> snapshot;
+		const Scene* scene = handle.scene;
+		if (handle.versions)
+		{
+			snapshot = std::make_unique<SceneVersions::Snapshot>(handle.versions->Acquire());
+			scene = snapshot->Get();
+		}
+
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + handle.timeLimit;
+		bool limited = handle.timeLimit > std::chrono::steady_clock::duration::zero();
+
+		View view = BeginView(*scene, camera, handle.target);
+		view.stop = &handle.stop;
+		glm::uvec2 size = view.size;
+
+		uint32_t batchSize = handle.batchSize;
+		glm::uvec2 batchCount = glm::uvec2((size.x + batchSize - 1) / batchSize, (size.y + batchSize - 1) / batchSize);
+		handle.completedTiles = 0;
+		handle.tileCount = batchCount.x * batchCount.y;
+
+		std::atomic<bool> expired(false);
+		threadPool.ParallelFor(batchCount.x * batchCount.y, [this, &handle, &view, &expired, size, batchSize, batchCount, deadline, limited](uint32_t batch) {
+			if (handle.stop.load(std::memory_order_relaxed) || expired.load(std::memory_order_relaxed))
+				return;
+
+			if (limited && std::chrono::steady_clock::now() >= deadline)
+			{
+				expired = true;
+				return;
+			}
+
+			glm::uvec2 coord = glm::uvec2(batch % batchCount.x, batch / batchCount.x) * batchSize;
+			glm::uvec2 coord2 = glm::min(coord + batchSize, size);
+
+			RenderBatch(view, coord, coord2);
+
+			//A tile whose rays gave up does not count
+			if (handle.stop.load(std::memory_order_relaxed))
+				return;
+
+			handle.completedTiles++;
+
+			if (handle.update)
+			{
+				std::lock_guard<std::mutex> lock(handle.updateMutex);
+				handle.update(view.target->pixels.data(), size, coord, coord2);
+			}
+		});
+
+		bool complete = handle.completedTiles == handle.tileCount;
+		if (complete && settings.mode == RenderMode::Deterministic && settings.antiAliasing)
+			AntiAlias(view, glm::uvec2(0, 0), size);
+		if (complete && settings.denoise)
+			DenoiseAtrous(threadPool, size, view.target->pixels.data(), view.target->gBuffer, settings.denoiseSettings);
+
+		//Every tile is done, the whole target can be read
+		if (complete && handle.update)
+		{
+			std::lock_guard<std::mutex> lock(handle.updateMutex);
+			handle.update(view.target->pixels.data(), size, glm::uvec2(0, 0), size);
+		}
+
+		std::lock_guard<std::mutex> lock(handle.mutex);
+		if (handle.restart && !handle.cancelled)
+			continue;
+
+		handle.status = handle.cancelled ? RenderStatus::Cancelled : complete ? RenderStatus::Completed : RenderStatus::DeadlineExpired;
+		handle.running = false;
+		handle.finished.notify_all();
+		return;
+	}
+}
+
+RenderHandle::RenderHandle(RayMarcher& renderer, const Scene* scene, SceneVersions* versions, const Camera& camera, RenderTarget& target,
+	RenderUpdateFunction update, uint32_t batchSize, std::chrono::steady_clock::duration timeLimit)
+	: renderer(renderer), scene(scene), versions(versions), target(target), update(update), batchSize(batchSize), timeLimit(timeLimit),
+	tileCount(0), completedTiles(0), stop(false), camera(camera), restart(false), cancelled(false), running(false),
+	status(RenderStatus::Running)
+{}
+
+RenderHandle::~RenderHandle()
+{
+	Cancel();
+	Wait();
+}
+
+void RenderHandle::Cancel()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	cancelled = true;
+	stop = true;
+}
+
+void RenderHandle::Restart(const Camera& camera)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->camera = camera;
+	restart = true;
+	cancelled = false;
+	stop = true;
+
+	if (!running)
+	{
+		//The last task has already released the handle, replacing its future only joins the thread
+		running = true;
+		status = RenderStatus::Running;
+		task = std::async(std::launch::async, [this]() { renderer.RunAsyncRender(*this); });
+	}
+}
+
+void RenderHandle::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this]() { return !running; });
+}
+
+bool RenderHandle::WaitFor(std::chrono::steady_clock::duration timeout)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return finished.wait_for(lock, timeout, [this]() { return !running; });
+}
+
+RenderStatus RenderHandle::GetStatus()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return status;
+}
@@ -1,6 +1,10 @@
 #pragma once
 #include "common.h"
 #include "Objects.h"
+#include "ThreadPool.h"
+#include "Denoiser.h"
+#include "Scene.h"
+#include "Camera.h"
 
 struct Ray
 {
@@ -8,36 +12,369 @@ struct Ray
 	glm::vec3 direction;
 };
 
-class RayMarcher
+struct Hit
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	float depth;
+	Material material;
+	MaterialId materialId;
+};
+
+enum class RenderMode
+{
+	Deterministic, //Mirror reflections, one frame per Render call
+	PathTracing, //Monte Carlo, every Render call adds samples to the pixels that have not converged yet
+};
+
+enum class RayType
+{
+	Primary,
+	Secondary, //Reflections and path traced bounces
+	Shadow,
+};
+
+#define RAY_TYPE_COUNT 3
+
+struct MarchStatistics
+{
+	uint64_t rays[RAY_TYPE_COUNT];
+	uint64_t steps[RAY_TYPE_COUNT];
+	uint64_t budgetHits[RAY_TYPE_COUNT]; //Rays that ran out of steps
+	uint64_t boundsMisses[RAY_TYPE_COUNT]; //Rays that missed the scene bounds and were not marched
+};
+
+enum class SamplePattern
+{
+	Grid2x2,
+	RotatedGrid4,
+	Queens8,
+};
+
+struct RenderSettings
+{
+	RenderMode mode = RenderMode::Deterministic;
+
+	//A ray hits once the distance drops below the width of its cone at the current depth, footprint * pixel angle * depth,
+	//so distant surfaces stop at the precision a pixel can show, hitEpsilon is the floor near the origin
+	//Reflected and path traced bounces use the tighter secondary footprint as curved mirrors magnify their error
+	float hitEpsilon = 0.0001f;
+	float primaryHitFootprint = 0.5f;
+	float secondaryHitFootprint = 0.125f;
+
+	//Steps a ray may take before giving up, rays are also clipped to the scene bounds first
+	//A primary or secondary ray out of steps hits where it stopped if it is within budgetHitFactor times the hit threshold
+	//of a surface, grazing it, and misses otherwise, a shadow ray keeps the penumbra estimated so far
+	uint32_t primaryStepBudget = 256;
+	uint32_t secondaryStepBudget = 128;
+	uint32_t shadowStepBudget = 128;
+	float budgetHitFactor = 4.0f;
+
+	//Primary and secondary rays stop marching within hitRefinementFactor times the hit threshold, then take up to
+	//hitRefinementSteps samples, secant steps where their sample brackets the root and sphere tracing steps otherwise,
+	//bisecting once a step lands inside, until the distance is below hitEpsilon
+	//This places hits closer to the surface than the threshold, rays that stop approaching (grazing a silhouette)
+	//or end above the hit threshold resume marching, so coverage does not grow
+	uint32_t hitRefinementSteps = 4;
+	float hitRefinementFactor = 4.0f;
+
+	//Reflection rays stop once the product of the material colors and reflectivities along them falls below the
+	//threshold, path tracing instead applies russian roulette from the given bounce on so it stays unbiased
+	uint32_t maxReflections = 5;
+	float throughputThreshold = 0.01f;
+	uint32_t russianRouletteBounce = 2;
+
+	//Ambient occlusion is estimated on every other pixel of a tile and reused by its neighbors
+	bool ambientOcclusion = true;
+	uint32_t ambientOcclusionSamples = 5;
+	float ambientOcclusionRadius = 0.6f;
+
+	//Extra samples are only spent on pixels whose neighbors differ in coverage, depth, normal, material or color
+	bool antiAliasing = true;
+	SamplePattern antiAliasingPattern = SamplePattern::RotatedGrid4;
+	float antiAliasingDepthThreshold = 0.05f; //Relative depth difference
+	float antiAliasingNormalThreshold = 0.9f; //Minimum normal dot product
+	float antiAliasingContrastThreshold = 0.1f; //Luminance difference
+
+	//Path tracing, a pixel stops sampling once the standard error of its mean luminance drops below
+	//pathTracingErrorThreshold relative to the mean
+	uint32_t pathTracingSamplesPerPass = 4;
+	uint32_t pathTracingMinSamples = 16;
+	uint32_t pathTracingMaxSamples = 1024;
+	uint32_t pathTracingMaxBounces = 5;
+	float pathTracingErrorThreshold = 0.02f;
+
+	//Runs after the whole frame is rendered, guided by the primary hit depth, normal and material
+	bool denoise = false;
+	DenoiseSettings denoiseSettings;
+
+	//Builds the scene as native code in the background, the entity tree is rendered until the library is loaded
+	//Scenes that animate with time always render from the tree
+	bool compileScene = false;
+
+	//Primary rays march a copy of the scene without the union members and primitives outside the view, rebuilt for
+	//every frame, secondary and shadow rays keep the full scene
+	//Does nothing for a compiled scene
+	bool frustumCulling = true;
+
+	//Deterministic tiles are split into a screen space quadtree down to quadtreeLeafSize pixels, each region's frustum
+	//is cut into depth slices that an interval evaluation of the scene classifies as empty or occupied
+	//Primary rays then start at the first occupied slice, stop after the last one and march the scene pruned to the
+	//occupied part, rays of regions with no occupied slice are not marched at all
+	bool quadtree = true;
+	uint32_t quadtreeLeafSize = 8;
+	uint32_t quadtreeDepthSlices = 8;
+
+	//Primary rays of deterministic tiles start where the march of their left neighbor (the pixel above for the first
+	//column) proves the space empty: each of its samples is a free ball, still at least distance - depth * spread wide
+	//around this ray, spread being the distance between the unit directions
+	//A start found inside geometry (a scene that is not 1-Lipschitz) falls back to the region's near depth
+	bool coherentStartDepths = true;
+};
+
+#define MAX_BOUNCES 16
+
+//Image, guides and path tracing state of one view, plus what the renderer caches for it between frames
+//A target takes one render at a time, concurrent views each render into their own
+struct RenderTarget
 {
-private:
 	glm::uvec2 size;
-	float aspectRatio;
-	float fovFactor;
 
-	glm::vec3 cameraPosition;
-	glm::mat3 cameraRotation;
+	std::vector<glm::vec3> pixels;
+	GBuffer gBuffer;
+
+	//Surface color and ambient occlusion of the primary hits, the anti-aliasing pass compares the first and shades its
+	//extra samples with the second
+	std::vector<glm::vec3> albedo;
+	std::vector<float> occlusion;
+
+	//Path tracing accumulation, cleared by ResetAccumulation
+	std::vector<glm::vec3> accumulation;
+	std::vector<float> luminanceSum, luminanceSquaredSum;
+	std::vector<uint32_t> sampleCounts;
+	std::vector<uint8_t> converged;
+	std::atomic<uint32_t> convergedCount;
+
+	//Camera space directions through the pixel centers, rebuilt when the field of view changes, and the same
+	//directions rotated to world space, rebuilt when the rotation changes (a moving camera that does not turn keeps them)
+	//Both are structures of arrays so the rotation vectorizes
+	std::vector<float> cameraDirectionX, cameraDirectionY, cameraDirectionZ;
+	std::vector<float> rayDirectionX, rayDirectionY, rayDirectionZ;
+	float cameraDirectionsFov;
+	glm::mat3 rayDirectionsRotation;
+
+	//Scene culled to the last camera
+	SceneArena frameArena;
+
+	RenderTarget(glm::uvec2 size);
+	RenderTarget(const RenderTarget&) = delete;
+	RenderTarget& operator=(const RenderTarget&) = delete;
+
+	//Must be called when the camera or the scene changes while path tracing
+	void ResetAccumulation();
+	float GetConvergence() const { return (float)convergedCount / (float)(size.x * size.y); }
+};
+
+enum class RenderStatus
+{
+	Running,
+	Completed,
+	Cancelled, //The tiles in flight when it stopped are left unfinished
+	DeadlineExpired, //Tiles not started before the time limit still hold the previous frame
+};
+
+//Receives the target's pixels from AsyncRender each time the tile from regionMin up to regionMax is finished, one call at
+//a time, other tiles may still be rendering so only that rectangle is safe to read during the call
+//A completed frame ends with a call covering the whole target, after its anti-aliasing and denoising passes
+typedef std::function<void(const glm::vec3* pixels, glm::uvec2 size, glm::uvec2 regionMin, glm::uvec2 regionMax)> RenderUpdateFunction;
 
-	glm::vec3* pixels;
+class RayMarcher;
 
-	Entity* scene;
+//Progress and control of an AsyncRender, destroying the handle cancels the render and waits for it
+//The renderer, the scene (or its versions) and the target must outlive the handle
+class RenderHandle
+{
+private:
+	friend class RayMarcher;
 
-	std::shared_mutex mutex;
+	RayMarcher& renderer;
+	const Scene* scene;
+	SceneVersions* versions; //Each frame renders the version current when it starts, nullptr for a fixed scene
+	RenderTarget& target;
+	RenderUpdateFunction update;
+	uint32_t batchSize;
+	std::chrono::steady_clock::duration timeLimit; //Per frame, zero for none
 
-	Ray GetCameraRay(glm::uvec2 coord);
+	std::atomic<uint32_t> tileCount;
+	std::atomic<uint32_t> completedTiles;
+	std::atomic<bool> stop; //Polled between tiles and inside march loops, set by Cancel and Restart
 
-	glm::vec3 GetNormal(glm::vec3 position, float distance);
+	std::mutex mutex;
+	std::condition_variable finished;
+	Camera camera;
+	bool restart;
+	bool cancelled;
+	bool running;
+	RenderStatus status;
+	std::future<void> task;
 
-	glm::vec3 CastRay(glm::vec3 origin, glm::vec3 direction, float depth = 0.0f, uint32_t reflections = 0);
+	std::mutex updateMutex;
 
-	void RenderBatch(glm::uvec2 topLeft, glm::uvec2 bottomRight);
+	RenderHandle(RayMarcher& renderer, const Scene* scene, SceneVersions* versions, const Camera& camera, RenderTarget& target,
+		RenderUpdateFunction update, uint32_t batchSize, std::chrono::steady_clock::duration timeLimit);
 
 public:
-	RayMarcher(glm::uvec2 size, float fov);
+	RenderHandle(const RenderHandle&) = delete;
+	RenderHandle& operator=(const RenderHandle&) = delete;
+	~RenderHandle();
+
+	void Cancel();
 
-	glm::vec3* Render(uint32_t batchSize = 32);
-	std::future<void> AsyncRender(std::function<void(glm::vec3*, glm::uvec2)> update, uint32_t batchSize = 32);
+	//Abandons the frame in flight and renders from the new camera instead, or starts a new frame if the last one is
+	//over, a pending cancellation is dropped
+	void Restart(const Camera& camera);
 
 	void Wait();
+	//Returns false if the render is still running after the timeout
+	bool WaitFor(std::chrono::steady_clock::duration timeout);
+
+	RenderStatus GetStatus();
+	uint32_t GetCompletedTiles() const { return completedTiles; }
+	uint32_t GetTileCount() const { return tileCount; }
+	float GetProgress() const { return tileCount > 0 ? (float)completedTiles / (float)tileCount : 0.0f; }
 };
 
+//Renders views of shared scenes into their targets, several renders (of the same scene or not) can run at once from
+//different threads and share the thread pool
+//Only settings and statistics live here, the settings must not change while a render runs
+class RayMarcher
+{
+private:
+	friend class RenderHandle;
+
+	ThreadPool& threadPool;
+	RenderSettings settings;
+
+	//Number of surface interactions per traced path
+	std::atomic<uint64_t> bounceHistogram[MAX_BOUNCES + 1];
+	void RecordBounces(uint32_t bounces) { bounceHistogram[glm::min(bounces, (uint32_t)MAX_BOUNCES)]++; }
+
+	std::atomic<uint64_t> rayCounts[RAY_TYPE_COUNT];
+	std::atomic<uint64_t> stepCounts[RAY_TYPE_COUNT];
+	std::atomic<uint64_t> budgetHits[RAY_TYPE_COUNT];
+	std::atomic<uint64_t> boundsMisses[RAY_TYPE_COUNT];
+	void RecordMarch(RayType type, uint32_t steps, bool budgetHit, bool boundsMiss);
+
+	//What the tiles of one render read, built when it starts
+	struct View
+	{
+		const Scene* scene;
+		Entity* entity; //Compiled when enabled and ready
+		Entity* primaryScene; //Culled to the camera, nullptr when nothing is in view
+		RenderTarget* target;
+
+		glm::uvec2 size;
+		float aspectRatio;
+		float fovFactor;
+		float pixelAngle; //Angle covered by one pixel at the center of the image
+
+		glm::vec3 cameraPosition;
+		glm::mat3 cameraRotation;
+
+		const std::atomic<bool>* stop; //Set once the render is abandoned, nullptr when it cannot be
+	};
+
+	View BeginView(const Scene& scene, const Camera& camera, RenderTarget& target);
+	Frustum GetCameraFrustum(const View& view) const;
+	void UpdateRayDirections(const View& view, float fov);
+
+	//coord is in pixels from the image corner, pixel (x, y) covers x to x + 1 and y to y + 1 so its center is at + 0.5
+	Ray GetCameraRay(const View& view, glm::vec2 coord) const;
+
+	//Same ray as GetCameraRay at the pixel center, read from the target's tables
+	Ray GetPixelRay(const View& view, glm::uvec2 pixel) const
+	{
+		const RenderTarget& target = *view.target;
+		uint32_t index = pixel.y * view.size.x + pixel.x;
+		return { view.cameraPosition, glm::vec3(target.rayDirectionX[index], target.rayDirectionY[index], target.rayDirectionZ[index]) };
+	}
+
+	//Scene and depth range the primary rays of a quadtree region march, entity is nullptr when the region is empty
+	struct RegionTape
+	{
+		Entity* entity;
+		float near;
+		float far;
+	};
+
+	Bounds GetRegionBounds(const View& view, glm::vec2 regionMin, glm::vec2 regionMax, float near, float far) const;
+	void ClassifyRegion(const View& view, SceneArena& tapeArena, RegionTape tape, glm::uvec2 regionMin, glm::uvec2 regionMax,
+		glm::uvec2 topLeft, glm::uvec2 tileSize, RegionTape* tapes);
+
+	glm::vec3 GetNormal(Entity* entity, glm::vec3 position, float distance);
+
+	float CastShadowRay(const View& view, glm::vec3 origin, glm::vec3 direction, float maxDepth, float softness);
+	glm::vec3 GetDirectLight(const View& view, glm::vec3 position, glm::vec3 normal, float occlusion);
+
+	float GetAmbientOcclusion(const View& view, glm::vec3 position, glm::vec3 normal);
+	void GetTileAmbientOcclusion(const View& view, glm::uvec2 tileSize, const Hit* hits, const uint8_t* hitMask, float* occlusion);
+
+	//Limits [near, far] to the part of the ray inside the scene bounds, false when it misses them
+	bool ClipRay(const View& view, glm::vec3 origin, glm::vec3 direction, float& near, float& far) const;
+
+	//Moves depth and distance towards the surface, returns the number of distance evaluations, at most maxSteps
+	uint32_t RefineHit(Entity* entity, glm::vec3 origin, glm::vec3 direction, float previousDepth, float previousDistance, float& depth, float& distance, uint32_t maxSteps);
+
+	//Marches the scene of the ray type unless an entity is given, the trace receives the depth and distance of every
+	//march step outside the surface
+	bool MarchRay(const View& view, glm::vec3 origin, glm::vec3 direction, float depth, RayType type, Hit& hit, Entity* entity = nullptr,
+		float maxDepth = 100.0f, std::vector<glm::vec2>* trace = nullptr);
+
+	//Depth up to which a neighbor's trace proves the ray empty, from the given start on
+	float GetCoherentStart(const std::vector<glm::vec2>& trace, float spread, float start) const;
+	glm::vec3 ShadeHit(const View& view, const Hit& hit, glm::vec3 direction, float occlusion);
+	glm::vec3 CastRay(const View& view, glm::vec3 origin, glm::vec3 direction);
+
+	bool IsEdge(const RenderTarget& target, uint32_t pixel, uint32_t pixel2);
+	void AntiAlias(const View& view, glm::uvec2 regionMin, glm::uvec2 regionMax);
+
+	glm::vec3 TracePath(const View& view, glm::vec3 origin, glm::vec3 direction, uint32_t& seed, Hit* primaryHit = nullptr);
+	void RenderBatchPathTraced(const View& view, glm::uvec2 topLeft, glm::uvec2 bottomRight);
+
+	void RenderBatch(const View& view, glm::uvec2 topLeft, glm::uvec2 bottomRight);
+
+	//Runs the frames of an async render until one finishes without being restarted
+	void RunAsyncRender(RenderHandle& handle);
+
+public:
+	RayMarcher(ThreadPool& threadPool = ThreadPool::GetShared());
+
+	RenderSettings& GetSettings() { return settings; }
+	ThreadPool& GetThreadPool() { return threadPool; }
+
+	//Index i holds the number of paths that ended after i surface interactions (the last bucket collects the rest)
+	std::vector<uint64_t> GetBounceHistogram() const;
+	void ResetBounceHistogram();
+
+	//Ray, step, budget and bounds counters per ray type since the last reset, summed over every view
+	MarchStatistics GetMarchStatistics() const;
+	void ResetMarchStatistics();
+
+	//The scene must outlive the render
+	//An edited scene is rendered from a snapshot of its current version, which it holds for the whole frame
+	glm::vec3* Render(const Scene& scene, const Camera& camera, RenderTarget& target, uint32_t batchSize = 32);
+	glm::vec3* Render(SceneVersions& scene, const Camera& camera, RenderTarget& target, uint32_t batchSize = 32);
+
+	//Only renders the tiles overlapping the pixels from regionMin up to regionMax, the rest of the target is left as is
+	glm::vec3* RenderRegion(const Scene& scene, const Camera& camera, RenderTarget& target, glm::uvec2 regionMin, glm::uvec2 regionMax,
+		uint32_t batchSize = 32);
+
+	//Renders on the thread pool without blocking, update is called after every finished tile, see RenderUpdateFunction
+	//A time limit makes each frame stop starting tiles once it has passed, leaving the best image it got to
+	std::unique_ptr<RenderHandle> AsyncRender(const Scene& scene, const Camera& camera, RenderTarget& target,
+		RenderUpdateFunction update = nullptr, uint32_t batchSize = 32,
+		std::chrono::steady_clock::duration timeLimit = std::chrono::steady_clock::duration::zero());
+	std::unique_ptr<RenderHandle> AsyncRender(SceneVersions& scene, const Camera& camera, RenderTarget& target,
+		RenderUpdateFunction update = nullptr, uint32_t batchSize = 32,
+		std::chrono::steady_clock::duration timeLimit = std::chrono::steady_clock::duration::zero());
+};
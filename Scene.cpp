@@ -0,0 +1,163 @@
+#include "Scene.h"
+
+Scene::Scene(Entity* root, const MaterialTable& materials, std::vector<Light> lights, glm::vec3 ambientLight)
+	: materials(materials), lights(std::move(lights)), ambientLight(ambientLight), compiled(nullptr)
+{
+	tree = root->Clone(arena);
+	bounds = tree->GetBounds().Inflate(glm::vec3(0.01f));
+}
+
+Entity* Scene::GetCompiled() const
+{
+	if (Entity* entity = compiled.load(std::memory_order_acquire))
+		return entity;
+
+	std::lock_guard<std::mutex> lock(compileMutex);
+	if (Entity* entity = compiled.load(std::memory_order_relaxed))
+		return entity;
+
+	if (!compiledModule.valid())
+		compiledModule = compiler.CompileAsync(tree);
+
+	if (compiledModule.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return tree;
+
+	//A failed build settles on the tree for good
+	Entity* entity = tree;
+	if (std::shared_ptr<SceneModule> module = compiledModule.get())
+	{
+		compiledEntity = std::make_unique<CompiledEntity>(module, tree);
+		entity = compiledEntity.get();
+	}
+
+	compiled.store(entity, std::memory_order_release);
+	return entity;
+}
+
+bool Scene::IsCompiling() const
+{
+	std::lock_guard<std::mutex> lock(compileMutex);
+	return compiledModule.valid() && compiledModule.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+}
+
+SceneVersions::Snapshot::Snapshot(Snapshot&& other) noexcept
+	: versions(other.versions), slot(other.slot), scene(other.scene)
+{
+	other.versions = nullptr;
+	other.scene = nullptr;
+}
+
+SceneVersions::Snapshot& SceneVersions::Snapshot::operator=(Snapshot&& other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+		versions = other.versions;
+		slot = other.slot;
+		scene = other.scene;
+		other.versions = nullptr;
+		other.scene = nullptr;
+	}
+	return *this;
+}
+
+SceneVersions::Snapshot::~Snapshot()
+{
+	Release();
+}
+
+void SceneVersions::Snapshot::Release()
+{
+	if (!versions)
+		return;
+
+	versions->readerEpochs[slot].store(0, std::memory_order_release);
+	versions = nullptr;
+	scene = nullptr;
+}
+
+SceneVersions::SceneVersions(std::unique_ptr<Scene> scene)
+	: current(scene.release()), epoch(1)
+{
+	for (std::atomic<uint64_t>& readerEpoch : readerEpochs)
+		readerEpoch.store(0, std::memory_order_relaxed);
+}
+
+SceneVersions::~SceneVersions()
+{
+	for (std::pair<uint64_t, Scene*>& version : retired)
+		delete version.second;
+	delete current.load();
+}
+
+void SceneVersions::Publish(std::unique_ptr<Scene> scene)
+{
+	//The swap comes before the epoch moves on, so a reader pinned after the increment can only load the new version
+	Scene* previous = current.exchange(scene.release());
+	uint64_t replacedIn = epoch.fetch_add(1);
+
+	std::lock_guard<std::mutex> lock(retiredMutex);
+	retired.push_back({ replacedIn, previous });
+	ReclaimLocked();
+}
+
+SceneVersions::Snapshot SceneVersions::Acquire()
+{
+	for (;;)
+	{
+		for (uint32_t slot = 0; slot < SCENE_READER_SLOTS; slot++)
+		{
+			uint64_t pinned = epoch.load();
+			uint64_t free = 0;
+			if (!readerEpochs[slot].compare_exchange_strong(free, pinned))
+				continue;
+
+			//A writer may have moved on and scanned the slots between reading the epoch and pinning it, in which
+			//case it could free the version current at the stale epoch, so pin again until the epoch holds
+			for (uint64_t now = epoch.load(); now != pinned; now = epoch.load())
+			{
+				pinned = now;
+				readerEpochs[slot].store(pinned);
+			}
+
+			return Snapshot(this, slot, current.load());
+		}
+
+		std::this_thread::yield();
+	}
+}
+
+void SceneVersions::Reclaim()
+{
+	std::lock_guard<std::mutex> lock(retiredMutex);
+	ReclaimLocked();
+}
+
+void SceneVersions::ReclaimLocked()
+{
+	uint64_t oldestPinned = UINT64_MAX;
+	for (std::atomic<uint64_t>& readerEpoch : readerEpochs)
+	{
+		uint64_t pinned = readerEpoch.load();
+		if (pinned != 0)
+			oldestPinned = glm::min(oldestPinned, pinned);
+	}
+
+	//Readers pinned at the epoch a version was replaced in may still hold it, later ones cannot
+	//Versions with a native build in flight wait for the next pass instead of blocking the writer on the compiler
+	size_t kept = 0;
+	for (std::pair<uint64_t, Scene*>& version : retired)
+	{
+		if (version.first < oldestPinned && !version.second->IsCompiling())
+			delete version.second;
+		else
+			retired[kept++] = version;
+	}
+	retired.resize(kept);
+}
+
+size_t SceneVersions::GetRetiredCount()
+{
+	std::lock_guard<std::mutex> lock(retiredMutex);
+	return retired.size();
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "common.h"
+#include "Objects.h"
+#include "SceneCompiler.h"
+
+enum class LightType
+{
+	Directional,
+	Point,
+};
+
+struct Light
+{
+	LightType type;
+	glm::vec3 direction; //Towards the light, directional lights only
+	glm::vec3 position; //Point lights only
+	glm::vec3 color;
+	float softness; //Penumbra sharpness, higher is harder
+};
+
+//Geometry, materials and lights of a rendered scene
+//Nothing changes after construction apart from the native build replacing the distance functions once it is loaded,
+//so any number of renderers and views can share one scene across threads
+class Scene
+{
+private:
+	SceneArena arena;
+	Entity* tree;
+	Bounds bounds;
+	MaterialTable materials;
+
+	std::vector<Light> lights;
+	glm::vec3 ambientLight;
+
+	mutable std::mutex compileMutex;
+	mutable SceneCompiler compiler;
+	mutable std::shared_future<std::shared_ptr<SceneModule>> compiledModule;
+	mutable std::unique_ptr<CompiledEntity> compiledEntity;
+	mutable std::atomic<Entity*> compiled;
+
+public:
+	//The tree is laid out again contiguously in traversal order in the scene's own arena, the caller's arena and
+	//entities can go once this returns
+	Scene(Entity* root, const MaterialTable& materials, std::vector<Light> lights, glm::vec3 ambientLight);
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	Entity* GetTree() const { return tree; }
+
+	//Starts building the scene as native code on the first call, returns the compiled scene once it is loaded and the
+	//entity tree until then (or if the build failed)
+	Entity* GetCompiled() const;
+
+	//True while the native build runs, destroying the scene waits for it
+	bool IsCompiling() const;
+
+	//Bounds of the tree with a margin so surfaces on them are still reached within the hit threshold
+	const Bounds& GetBounds() const { return bounds; }
+
+	const MaterialTable& GetMaterials() const { return materials; }
+	const std::vector<Light>& GetLights() const { return lights; }
+	glm::vec3 GetAmbientLight() const { return ambientLight; }
+};
+
+#define SCENE_READER_SLOTS 64
+
+//The current version of an edited scene, edits publish a whole new scene and renders read a snapshot of whichever
+//version was current when they started
+//Neither side waits for the other: a reader pins the epoch in a slot before loading the current version, and a
+//replaced version is only deleted once no slot is pinned at or before the epoch it was replaced in
+//Writers serialize among themselves while retiring versions
+class SceneVersions
+{
+private:
+	std::atomic<Scene*> current;
+	std::atomic<uint64_t> epoch;
+	std::atomic<uint64_t> readerEpochs[SCENE_READER_SLOTS]; //0 for a free slot
+
+	std::mutex retiredMutex;
+	std::vector<std::pair<uint64_t, Scene*>> retired; //Epoch the version was replaced in
+
+	void ReclaimLocked();
+
+public:
+	//Keeps its version alive, move only
+	class Snapshot
+	{
+	private:
+		SceneVersions* versions;
+		uint32_t slot;
+		const Scene* scene;
+
+		friend class SceneVersions;
+		Snapshot(SceneVersions* versions, uint32_t slot, const Scene* scene) : versions(versions), slot(slot), scene(scene) {}
+
+	public:
+		Snapshot(Snapshot&& other) noexcept;
+		Snapshot& operator=(Snapshot&& other) noexcept;
+		~Snapshot();
+
+		void Release();
+
+		const Scene& operator*() const { return *scene; }
+		const Scene* operator->() const { return scene; }
+		const Scene* Get() const { return scene; }
+	};
+
+	SceneVersions(std::unique_ptr<Scene> scene);
+	SceneVersions(const SceneVersions&) = delete;
+	SceneVersions& operator=(const SceneVersions&) = delete;
+
+	//Every snapshot must be released first
+	~SceneVersions();
+
+	//Renders that start after this returns see the new version, the ones in flight finish on theirs
+	//Also frees the versions no reader holds anymore
+	void Publish(std::unique_ptr<Scene> scene);
+
+	//Never blocks while fewer than SCENE_READER_SLOTS snapshots are held at once, yields until a slot frees up beyond that
+	Snapshot Acquire();
+
+	//Frees the versions no reader holds anymore without publishing, for writers that stop editing for a while
+	void Reclaim();
+
+	//Replaced versions still waiting for their readers
+	size_t GetRetiredCount();
+};
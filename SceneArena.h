@@ -0,0 +1,92 @@
+#pragma once
+#include "common.h"
+
+//Owns the nodes of one scene
+//Nodes are placed one after the other in large blocks, in creation order, and are all released together
+//Only nodes that are not trivially destructible (the ones holding std::vector) are visited on release
+//Child arrays (Union::entities, the primitive set lanes) stay in their std::vector on the heap : Union is built from a
+//caller's vector before any arena is involved and the sets grow one primitive at a time, a fixed arena span would need
+//copying on every growth and leave the old span unused until Reset, each array is one allocation next to its node
+class SceneArena
+{
+private:
+	struct Block
+	{
+		uint8_t* data;
+		size_t size;
+		size_t used;
+	};
+
+	struct Destructor
+	{
+		void* object;
+		void (*destroy)(void*);
+	};
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	std::vector<Destructor> destructors;
+
+	void* Allocate(size_t size, size_t alignment)
+	{
+		if (!blocks.empty())
+		{
+			Block& block = blocks.back();
+			size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+			if (offset + size <= block.size)
+			{
+				block.used = offset + size;
+				return block.data + offset;
+			}
+		}
+
+		//Offsets are aligned relative to the block start, new[] already aligns it for any fundamental type
+		size_t size2 = glm::max(blockSize, size + alignment);
+		blocks.push_back({ new uint8_t[size2], size2, 0 });
+
+		return Allocate(size, alignment);
+	}
+
+public:
+	SceneArena(size_t blockSize = 64 * 1024)
+		: blockSize(blockSize)
+	{}
+	SceneArena(const SceneArena&) = delete;
+	SceneArena& operator=(const SceneArena&) = delete;
+
+	~SceneArena()
+	{
+		Reset();
+	}
+
+	template<typename T, typename... Args>
+	T* Create(Args&&... args)
+	{
+		T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+		if (!std::is_trivially_destructible<T>::value)
+			destructors.push_back({ object, [](void* object) { ((T*)object)->~T(); } });
+
+		return object;
+	}
+
+	//Destroys every node, the arena can then be reused for another scene
+	void Reset()
+	{
+		for (auto it = destructors.rbegin(); it != destructors.rend(); it++)
+			it->destroy(it->object);
+		destructors.clear();
+
+		for (Block& block : blocks)
+			delete[] block.data;
+		blocks.clear();
+	}
+
+	size_t GetUsedBytes() const
+	{
+		size_t used = 0;
+		for (const Block& block : blocks)
+			used += block.used;
+		return used;
+	}
+};
@@ -0,0 +1,476 @@
+#include "SceneCodeWriter.h"
+
+SceneCodeWriter::SceneCodeWriter(SceneLanguage language, const MaterialTable* materials)
+	: language(language), materials(materials), variableCount(0), timeDependent(false)
+{}
+
+std::string SceneCodeWriter::Float(float value) const
+{
+	//None of the languages has a literal for infinity, the largest float stands in for it
+	assert(!glm::isnan(value));
+	if (glm::isinf(value))
+		value = value > 0.0f ? FLT_MAX : -FLT_MAX;
+
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.9g", value);
+
+	std::string text = buffer;
+	if (text.find_first_of(".en") == std::string::npos)
+		text += ".0";
+
+	return text + "f";
+}
+
+std::string SceneCodeWriter::Vec3(glm::vec3 value) const
+{
+	return Type("vec3") + "(" + Float(value.x) + ", " + Float(value.y) + ", " + Float(value.z) + ")";
+}
+
+std::string SceneCodeWriter::Subtract(const std::string& position, glm::vec3 offset) const
+{
+	if (offset == glm::vec3(0.0f))
+		return position;
+
+	return position + " - " + Vec3(offset);
+}
+
+std::string SceneCodeWriter::Declare(const std::string& type, const std::string& expression)
+{
+	std::string name = "v" + std::to_string(variableCount++);
+	code << "\t" << Type(type) << " " << name << " = " << expression << ";\n";
+
+	return name;
+}
+
+std::string SceneCodeWriter::Type(const std::string& type) const
+{
+	if (type == "material")
+		return language == SceneLanguage::Cpp ? "int" : Type("vec4");
+
+	if (language == SceneLanguage::Hlsl && type.compare(0, 3, "vec") == 0)
+		return "float" + type.substr(3);
+
+	return type;
+}
+
+std::string SceneCodeWriter::Function(const std::string& function) const
+{
+	if (language == SceneLanguage::Hlsl)
+	{
+		if (function == "mix")
+			return "lerp";
+		if (function == "atan")
+			return "atan2";
+	}
+
+	return function;
+}
+
+std::string SceneCodeWriter::Time()
+{
+	timeDependent = true;
+	return "time";
+}
+
+std::string SceneCodeWriter::Material(MaterialId material) const
+{
+	if (language == SceneLanguage::Cpp)
+		return std::to_string(material);
+
+	::Material parameters = materials->Get(material);
+	return Type("vec4") + "(" + Float(parameters.color.r) + ", " + Float(parameters.color.g) + ", " + Float(parameters.color.b) + ", " + Float(parameters.reflectivity) + ")";
+}
+
+std::string SceneCodeWriter::SelectMaterial(const std::string& condition, const std::string& material1, const std::string& material2) const
+{
+	return "(" + condition + ") ? " + material1 + " : " + material2;
+}
+
+std::string SceneCodeWriter::MixMaterials(const std::string& material1, const std::string& material2, const std::string& t, bool blend) const
+{
+	if (blend && language != SceneLanguage::Cpp)
+		return Function("mix") + "(" + material1 + ", " + material2 + ", " + t + ")";
+
+	return SelectMaterial(t + " >= 0.5f", material2, material1);
+}
+
+void SceneCodeWriter::Clear()
+{
+	code.str("");
+	variableCount = 0;
+}
+
+std::string GenerateShaderScene(Entity* scene, const MaterialTable& materials, SceneLanguage language)
+{
+	SceneCodeWriter writer(language, &materials);
+	std::string vec3 = writer.Type("vec3");
+	std::string source;
+
+	std::string distance = scene->EmitDistance(writer, "position");
+	source += "float " + std::string(language == SceneLanguage::Glsl ? "SDToScene" : "SDScene") + "(" + vec3 + " position)\n{\n";
+	source += writer.GetCode();
+	source += "\treturn " + distance + ";\n}\n";
+
+	writer.Clear();
+	SurfaceCode surface = scene->EmitSurface(writer, "position");
+	if (language == SceneLanguage::Glsl)
+	{
+		source += "Material SDToSceneMaterial(vec3 position)\n{\n";
+		source += writer.GetCode();
+		source += "\treturn Material(" + surface.distance + ", " + surface.material + ".rgb, " + surface.material + ".a, vec3(0.0f));\n}\n";
+	}
+	else
+	{
+		source += "Surface SDSceneSurface(float3 position)\n{\n";
+		source += writer.GetCode();
+		source += "\tSurface surface;\n";
+		source += "\tsurface.distanceToPoint = " + surface.distance + ";\n";
+		source += "\tsurface.color = " + surface.material + ".rgb;\n";
+		source += "\treturn surface;\n}\n";
+	}
+
+	return source;
+}
+
+std::string InsertShaderScene(const std::string& shader, const std::string& scene)
+{
+	const std::string marker = "#pragma scene";
+
+	size_t position = shader.find(marker);
+	if (position == std::string::npos)
+		return shader;
+
+	return shader.substr(0, position) + scene + shader.substr(position + marker.size());
+}
+
+//Primitives
+
+std::string Sphere::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return writer.Declare("float", "length(" + writer.Subtract(position, center) + ") - " + writer.Float(radius));
+}
+SurfaceCode Sphere::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return { EmitDistance(writer, position), writer.Material(material) };
+}
+
+static std::string EmitBoxDistance(SceneCodeWriter& writer, const std::string& position, glm::vec3 center, glm::vec3 extents)
+{
+	std::string q = writer.Declare("vec3", "abs(" + writer.Subtract(position, center) + ") - " + writer.Vec3(extents));
+	return writer.Declare("float", "length(max(" + q + ", " + writer.Vec3(glm::vec3(0.0f)) + ")) + min(max(" + q + ".x, max(" + q + ".y, " + q + ".z)), 0.0f)");
+}
+
+std::string Box::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return EmitBoxDistance(writer, position, center, extents);
+}
+SurfaceCode Box::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return { EmitDistance(writer, position), writer.Material(material) };
+}
+
+std::string Torus::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string p = center == glm::vec3(0.0f) ? position : writer.Declare("vec3", writer.Subtract(position, center));
+	std::string q = writer.Declare("vec2", writer.Type("vec2") + "(length(" + writer.Type("vec2") + "(" + p + ".x, " + p + ".z)) - " + writer.Float(radii.x) + ", " + p + ".y)");
+	return writer.Declare("float", "length(" + q + ") - " + writer.Float(radii.y));
+}
+SurfaceCode Torus::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return { EmitDistance(writer, position), writer.Material(material) };
+}
+
+//Unions
+
+static std::string EmitMin(SceneCodeWriter& writer, const std::vector<std::string>& distances)
+{
+	std::string distance = distances[0];
+	for (size_t i = 1; i < distances.size(); i++)
+		distance = writer.Declare("float", "min(" + distance + ", " + distances[i] + ")");
+
+	return distance;
+}
+
+static SurfaceCode EmitClosest(SceneCodeWriter& writer, const std::vector<SurfaceCode>& surfaces)
+{
+	SurfaceCode surface = surfaces[0];
+	for (size_t i = 1; i < surfaces.size(); i++)
+	{
+		surface.material = writer.Declare("material", writer.SelectMaterial(surfaces[i].distance + " < " + surface.distance, surfaces[i].material, surface.material));
+		surface.distance = writer.Declare("float", "min(" + surface.distance + ", " + surfaces[i].distance + ")");
+	}
+
+	return surface;
+}
+
+std::string Union::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::vector<std::string> distances;
+	for (Entity* entity : entities)
+		distances.push_back(entity->EmitDistance(writer, position));
+
+	return EmitMin(writer, distances);
+}
+SurfaceCode Union::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	std::vector<SurfaceCode> surfaces;
+	for (Entity* entity : entities)
+		surfaces.push_back(entity->EmitSurface(writer, position));
+
+	return EmitClosest(writer, surfaces);
+}
+
+std::string SphereSet::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::vector<std::string> distances;
+	for (size_t i = 0; i < materials.size(); i++)
+		distances.push_back(writer.Declare("float", "length(" + writer.Subtract(position, glm::vec3(centerX[i], centerY[i], centerZ[i])) + ") - " + writer.Float(radius[i])));
+
+	return EmitMin(writer, distances);
+}
+SurfaceCode SphereSet::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	std::vector<SurfaceCode> surfaces;
+	for (size_t i = 0; i < materials.size(); i++)
+		surfaces.push_back({ writer.Declare("float", "length(" + writer.Subtract(position, glm::vec3(centerX[i], centerY[i], centerZ[i])) + ") - " + writer.Float(radius[i])), writer.Material(materials[i]) });
+
+	return EmitClosest(writer, surfaces);
+}
+
+std::string BoxSet::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::vector<std::string> distances;
+	for (size_t i = 0; i < materials.size(); i++)
+		distances.push_back(EmitBoxDistance(writer, position, glm::vec3(centerX[i], centerY[i], centerZ[i]), glm::vec3(extentX[i], extentY[i], extentZ[i])));
+
+	return EmitMin(writer, distances);
+}
+SurfaceCode BoxSet::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	std::vector<SurfaceCode> surfaces;
+	for (size_t i = 0; i < materials.size(); i++)
+		surfaces.push_back({ EmitBoxDistance(writer, position, glm::vec3(centerX[i], centerY[i], centerZ[i]), glm::vec3(extentX[i], extentY[i], extentZ[i])), writer.Material(materials[i]) });
+
+	return EmitClosest(writer, surfaces);
+}
+
+//Binary operators
+
+std::string Intersection::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string distance1 = entity1->EmitDistance(writer, position);
+	std::string distance2 = entity2->EmitDistance(writer, position);
+
+	return writer.Declare("float", "max(" + distance1 + ", " + distance2 + ")");
+}
+SurfaceCode Intersection::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	SurfaceCode surface1 = entity1->EmitSurface(writer, position);
+	SurfaceCode surface2 = entity2->EmitSurface(writer, position);
+
+	return {
+		writer.Declare("float", "max(" + surface1.distance + ", " + surface2.distance + ")"),
+		writer.Declare("material", writer.SelectMaterial(surface1.distance + " > " + surface2.distance, surface1.material, surface2.material)),
+	};
+}
+
+std::string Difference::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string distance1 = entity1->EmitDistance(writer, position);
+	std::string distance2 = entity2->EmitDistance(writer, position);
+
+	return writer.Declare("float", "max(" + distance1 + ", -" + distance2 + ")");
+}
+SurfaceCode Difference::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	SurfaceCode surface1 = entity1->EmitSurface(writer, position);
+	SurfaceCode surface2 = entity2->EmitSurface(writer, position);
+
+	return {
+		writer.Declare("float", "max(" + surface1.distance + ", -" + surface2.distance + ")"),
+		writer.Declare("material", writer.SelectMaterial(surface1.distance + " > -" + surface2.distance, surface1.material, surface2.material)),
+	};
+}
+
+std::string SmoothUnion::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string distance1 = entity1->EmitDistance(writer, position);
+	std::string distance2 = entity2->EmitDistance(writer, position);
+
+	std::string h = writer.Declare("float", "clamp(0.5f + (" + distance2 + " - " + distance1 + ") * " + writer.Float(0.5f / k) + ", 0.0f, 1.0f)");
+	return writer.Declare("float", writer.Function("mix") + "(" + distance2 + ", " + distance1 + ", " + h + ") - " + writer.Float(k) + " * " + h + " * (1.0f - " + h + ")");
+}
+SurfaceCode SmoothUnion::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	SurfaceCode surface1 = entity1->EmitSurface(writer, position);
+	SurfaceCode surface2 = entity2->EmitSurface(writer, position);
+
+	std::string h = writer.Declare("float", "clamp(0.5f + (" + surface2.distance + " - " + surface1.distance + ") * " + writer.Float(0.5f / k) + ", 0.0f, 1.0f)");
+	return {
+		writer.Declare("float", writer.Function("mix") + "(" + surface2.distance + ", " + surface1.distance + ", " + h + ") - " + writer.Float(k) + " * " + h + " * (1.0f - " + h + ")"),
+		writer.Declare("material", writer.MixMaterials(surface2.material, surface1.material, h, blendMaterials)),
+	};
+}
+
+std::string SmoothIntersection::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string distance1 = entity1->EmitDistance(writer, position);
+	std::string distance2 = entity2->EmitDistance(writer, position);
+
+	std::string h = writer.Declare("float", "clamp(0.5f - (" + distance2 + " - " + distance1 + ") * " + writer.Float(0.5f / k) + ", 0.0f, 1.0f)");
+	return writer.Declare("float", writer.Function("mix") + "(" + distance2 + ", " + distance1 + ", " + h + ") + " + writer.Float(k) + " * " + h + " * (1.0f - " + h + ")");
+}
+SurfaceCode SmoothIntersection::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	SurfaceCode surface1 = entity1->EmitSurface(writer, position);
+	SurfaceCode surface2 = entity2->EmitSurface(writer, position);
+
+	std::string h = writer.Declare("float", "clamp(0.5f - (" + surface2.distance + " - " + surface1.distance + ") * " + writer.Float(0.5f / k) + ", 0.0f, 1.0f)");
+	return {
+		writer.Declare("float", writer.Function("mix") + "(" + surface2.distance + ", " + surface1.distance + ", " + h + ") + " + writer.Float(k) + " * " + h + " * (1.0f - " + h + ")"),
+		writer.Declare("material", writer.MixMaterials(surface2.material, surface1.material, h, blendMaterials)),
+	};
+}
+
+std::string SmoothDifference::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string distance1 = entity1->EmitDistance(writer, position);
+	std::string distance2 = entity2->EmitDistance(writer, position);
+
+	std::string h = writer.Declare("float", "clamp(0.5f - (" + distance1 + " + " + distance2 + ") * " + writer.Float(0.5f / k) + ", 0.0f, 1.0f)");
+	return writer.Declare("float", writer.Function("mix") + "(" + distance1 + ", -" + distance2 + ", " + h + ") + " + writer.Float(k) + " * " + h + " * (1.0f - " + h + ")");
+}
+SurfaceCode SmoothDifference::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	SurfaceCode surface1 = entity1->EmitSurface(writer, position);
+	SurfaceCode surface2 = entity2->EmitSurface(writer, position);
+
+	std::string h = writer.Declare("float", "clamp(0.5f - (" + surface1.distance + " + " + surface2.distance + ") * " + writer.Float(0.5f / k) + ", 0.0f, 1.0f)");
+	return {
+		writer.Declare("float", writer.Function("mix") + "(" + surface1.distance + ", -" + surface2.distance + ", " + h + ") + " + writer.Float(k) + " * " + h + " * (1.0f - " + h + ")"),
+		writer.Declare("material", writer.MixMaterials(surface1.material, surface2.material, h, blendMaterials)),
+	};
+}
+
+std::string CubicSmoothUnion::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	std::string distance1 = entity1->EmitDistance(writer, position);
+	std::string distance2 = entity2->EmitDistance(writer, position);
+
+	std::string h = writer.Declare("float", "max(" + writer.Float(k) + " - abs(" + distance1 + " - " + distance2 + "), 0.0f) * " + writer.Float(1.0f / k));
+	return writer.Declare("float", "min(" + distance1 + ", " + distance2 + ") - " + h + " * " + h + " * " + h + " * " + writer.Float(k / 6.0f));
+}
+SurfaceCode CubicSmoothUnion::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	SurfaceCode surface1 = entity1->EmitSurface(writer, position);
+	SurfaceCode surface2 = entity2->EmitSurface(writer, position);
+
+	std::string h = writer.Declare("float", "max(" + writer.Float(k) + " - abs(" + surface1.distance + " - " + surface2.distance + "), 0.0f) * " + writer.Float(1.0f / k));
+	return {
+		writer.Declare("float", "min(" + surface1.distance + ", " + surface2.distance + ") - " + h + " * " + h + " * " + h + " * " + writer.Float(k / 6.0f)),
+		writer.Declare("material", writer.SelectMaterial(surface1.distance + " < " + surface2.distance, surface1.material, surface2.material)),
+	};
+}
+
+//Domain operators, axes that are left untouched are copied as is
+
+static std::string EmitRepeat(SceneCodeWriter& writer, const std::string& position, glm::vec3 period, const glm::vec3* limit)
+{
+	const char* axes[3] = { ".x", ".y", ".z" };
+
+	std::string components[3];
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		std::string axis = position + axes[i];
+		if (period[i] <= 1e-6f)
+		{
+			components[i] = axis;
+			continue;
+		}
+
+		std::string cell = "round(" + axis + " * " + writer.Float(1.0f / period[i]) + ")";
+		if (limit)
+			cell = "clamp(" + cell + ", " + writer.Float(-(*limit)[i]) + ", " + writer.Float((*limit)[i]) + ")";
+
+		components[i] = axis + " - " + writer.Float(period[i]) + " * " + cell;
+	}
+
+	return writer.Declare("vec3", writer.Type("vec3") + "(" + components[0] + ", " + components[1] + ", " + components[2] + ")");
+}
+
+std::string Repeat::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitDistance(writer, EmitRepeat(writer, position, period, nullptr));
+}
+SurfaceCode Repeat::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitSurface(writer, EmitRepeat(writer, position, period, nullptr));
+}
+
+std::string RepeatLimited::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitDistance(writer, EmitRepeat(writer, position, period, &limit));
+}
+SurfaceCode RepeatLimited::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitSurface(writer, EmitRepeat(writer, position, period, &limit));
+}
+
+static std::string EmitMirror(SceneCodeWriter& writer, const std::string& position, glm::vec3 center, glm::vec3 mirrored)
+{
+	const char* axes[3] = { ".x", ".y", ".z" };
+
+	std::string components[3];
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		std::string axis = position + axes[i];
+		if (mirrored[i] > 0.5f)
+			components[i] = "abs(" + axis + " - " + writer.Float(center[i]) + ") + " + writer.Float(center[i]);
+		else
+			components[i] = axis;
+	}
+
+	return writer.Declare("vec3", writer.Type("vec3") + "(" + components[0] + ", " + components[1] + ", " + components[2] + ")");
+}
+
+std::string Mirror::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitDistance(writer, EmitMirror(writer, position, center, axes));
+}
+SurfaceCode Mirror::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitSurface(writer, EmitMirror(writer, position, center, axes));
+}
+
+static std::string EmitPolarRepeat(SceneCodeWriter& writer, const std::string& position, glm::vec3 center, float angle)
+{
+	std::string q = center == glm::vec3(0.0f) ? position : writer.Declare("vec3", writer.Subtract(position, center));
+	std::string a = writer.Declare("float", writer.Function("atan") + "(" + q + ".z, " + q + ".x) + " + writer.Float(angle * 0.5f));
+	std::string a2 = writer.Declare("float", a + " - " + writer.Float(angle) + " * floor(" + a + " * " + writer.Float(1.0f / angle) + ") - " + writer.Float(angle * 0.5f));
+	std::string radius = writer.Declare("float", "length(" + writer.Type("vec2") + "(" + q + ".x, " + q + ".z))");
+
+	return writer.Declare("vec3", writer.Type("vec3") + "(cos(" + a2 + ") * " + radius + ", " + q + ".y, sin(" + a2 + ") * " + radius + ") + " + writer.Vec3(center));
+}
+
+std::string PolarRepeat::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitDistance(writer, EmitPolarRepeat(writer, position, center, angle));
+}
+SurfaceCode PolarRepeat::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitSurface(writer, EmitPolarRepeat(writer, position, center, angle));
+}
+
+static std::string EmitOscillate(SceneCodeWriter& writer, const std::string& position, glm::vec3 amplitude, float frequency)
+{
+	return writer.Declare("vec3", position + " - " + writer.Vec3(amplitude) + " * sin(" + writer.Time() + " * " + writer.Float(frequency) + ")");
+}
+
+std::string Oscillate::EmitDistance(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitDistance(writer, EmitOscillate(writer, position, amplitude, frequency));
+}
+SurfaceCode Oscillate::EmitSurface(SceneCodeWriter& writer, const std::string& position)
+{
+	return entity->EmitSurface(writer, EmitOscillate(writer, position, amplitude, frequency));
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "common.h"
+#include "Objects.h"
+
+enum class SceneLanguage
+{
+	Cpp,
+	Glsl,
+	Hlsl,
+};
+
+//Accumulates the body of a generated scene function as straight line code, every intermediate value
+//gets its own variable and every scene parameter is written as a literal
+class SceneCodeWriter
+{
+private:
+	SceneLanguage language;
+	const MaterialTable* materials;
+
+	std::ostringstream code;
+	uint32_t variableCount;
+	bool timeDependent;
+
+public:
+	//Shaders inline the material parameters, so they need the table the scene's ids refer to
+	SceneCodeWriter(SceneLanguage language = SceneLanguage::Cpp, const MaterialTable* materials = nullptr);
+
+	SceneLanguage GetLanguage() const { return language; }
+
+	//Infinities are written as the largest finite float, NaN is not allowed
+	std::string Float(float value) const;
+	std::string Vec3(glm::vec3 value) const;
+
+	//Position relative to the offset, no code is written for a zero offset
+	std::string Subtract(const std::string& position, glm::vec3 offset) const;
+
+	//Type is float, vec2, vec3 or material, returns the variable name
+	std::string Declare(const std::string& type, const std::string& expression);
+
+	//Names are given in GLSL and translated for the other languages
+	std::string Type(const std::string& type) const;
+	std::string Function(const std::string& function) const;
+
+	//Shaders read the time uniform, native code has no clock so it can only note that the scene needs one
+	std::string Time();
+	bool IsTimeDependent() const { return timeDependent; }
+
+	//Materials are ids in native code, blending resolves to the dominant operand
+	//Shaders hold them as the color and reflectivity in one vec4 and blend them like the CPU does
+	std::string Material(MaterialId material) const;
+	std::string SelectMaterial(const std::string& condition, const std::string& material1, const std::string& material2) const;
+	std::string MixMaterials(const std::string& material1, const std::string& material2, const std::string& t, bool blend) const;
+
+	std::string GetCode() const { return code.str(); }
+	void Clear();
+};
+
+//Writes the distance and material functions the shaders expect (SDToScene/SDToSceneMaterial in fs.glsl,
+//SDScene/SDSceneSurface with the Surface struct of pixelshader.hlsl) for the scene, they replace the "#pragma scene"
+//line of fs.glsl
+//pixelshader.hlsl keeps its hand written scene, an infinite plane under a sphere on a compound path that no entity
+//describes, HLSL output is for shaders built around an entity scene
+std::string GenerateShaderScene(Entity* scene, const MaterialTable& materials, SceneLanguage language);
+std::string InsertShaderScene(const std::string& shader, const std::string& scene);
@@ -0,0 +1,216 @@
+#include "SceneCompiler.h"
+#include "SceneCodeWriter.h"
+#include <filesystem>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define DEFAULT_COMPILE_COMMAND "cl /nologo /O2 /fp:fast /arch:AVX2 /LD \"{source}\" /Fe\"{output}\" > NUL"
+#define LIBRARY_EXTENSION ".dll"
+#else
+#define DEFAULT_COMPILE_COMMAND "c++ -O3 -march=native -shared -fPIC \"{source}\" -o \"{output}\""
+#define LIBRARY_EXTENSION ".so"
+#endif
+
+//Minimal vector math for the generated code, it only pulls in math.h so a build mostly costs the scene itself
+static const char* ScenePrelude = R"(#include <math.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define SCENE_EXPORT extern "C" __declspec(dllexport)
+#else
+#define SCENE_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+namespace scene
+{
+	struct vec2 { float x, y; vec2(float x, float y) : x(x), y(y) {} };
+	struct vec3 { float x, y, z; vec3(float x, float y, float z) : x(x), y(y), z(z) {} };
+
+	inline vec3 operator+(vec3 a, vec3 b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+	inline vec3 operator-(vec3 a, vec3 b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+	inline vec3 operator*(vec3 a, float b) { return vec3(a.x * b, a.y * b, a.z * b); }
+
+	inline float abs(float a) { return fabsf(a); }
+	inline float min(float a, float b) { return a < b ? a : b; }
+	inline float max(float a, float b) { return a > b ? a : b; }
+	inline float clamp(float a, float low, float high) { return min(max(a, low), high); }
+	inline float mix(float a, float b, float t) { return a + (b - a) * t; }
+	inline float round(float a) { return roundf(a); }
+	inline float floor(float a) { return floorf(a); }
+	inline float sin(float a) { return sinf(a); }
+	inline float cos(float a) { return cosf(a); }
+	inline float atan(float y, float x) { return atan2f(y, x); }
+
+	inline vec3 abs(vec3 a) { return vec3(fabsf(a.x), fabsf(a.y), fabsf(a.z)); }
+	inline vec3 max(vec3 a, vec3 b) { return vec3(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z)); }
+	inline float length(vec2 a) { return sqrtf(a.x * a.x + a.y * a.y); }
+	inline float length(vec3 a) { return sqrtf(a.x * a.x + a.y * a.y + a.z * a.z); }
+}
+)";
+
+SceneModule::~SceneModule()
+{
+	if (!library)
+		return;
+
+#ifdef _WIN32
+	FreeLibrary((HMODULE)library);
+#else
+	dlclose(library);
+#endif
+}
+
+//FNV-1a, stable across runs unlike std::hash
+static uint64_t HashSource(const std::string& source)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : source)
+	{
+		hash ^= (uint8_t)c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static void ReplaceAll(std::string& text, const std::string& from, const std::string& to)
+{
+	for (size_t i = text.find(from); i != std::string::npos; i = text.find(from, i + to.size()))
+		text.replace(i, from.size(), to);
+}
+
+SceneCompiler::SceneCompiler(const std::string& cacheDirectory, const std::string& command)
+	: cacheDirectory(cacheDirectory), command(command.empty() ? DEFAULT_COMPILE_COMMAND : command)
+{}
+
+std::string SceneCompiler::GenerateSource(Entity* scene)
+{
+	std::string source = ScenePrelude;
+
+	SceneCodeWriter writer;
+	std::string distance = scene->EmitDistance(writer, "p");
+
+	source += "\nnamespace scene\n{\n\nfloat Distance(vec3 p)\n{\n";
+	source += writer.GetCode();
+	source += "\treturn " + distance + ";\n}\n";
+
+	//The library would freeze the scene at one instant while materials keep following the tree
+	if (writer.IsTimeDependent())
+		return "";
+
+	writer.Clear();
+	SurfaceCode surface = scene->EmitSurface(writer, "p");
+
+	source += "\nfloat Surface(vec3 p, uint16_t* material)\n{\n";
+	source += writer.GetCode();
+	source += "\t*material = (uint16_t)(" + surface.material + ");\n";
+	source += "\treturn " + surface.distance + ";\n}\n\n}\n";
+
+	//Names inside the scene namespace hide the math.h overloads, the exported entry points stay outside
+	source += "\nSCENE_EXPORT float SceneDistance(float x, float y, float z) { return scene::Distance(scene::vec3(x, y, z)); }\n";
+	source += "SCENE_EXPORT float SceneSurface(float x, float y, float z, uint16_t* material) { return scene::Surface(scene::vec3(x, y, z), material); }\n";
+
+	return source;
+}
+
+std::shared_ptr<SceneModule> SceneCompiler::CompileSource(const std::string& source)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "scene_%016llx", (unsigned long long)HashSource(source));
+
+	std::error_code error;
+	std::filesystem::create_directories(cacheDirectory, error);
+
+	std::filesystem::path library = std::filesystem::path(cacheDirectory) / (std::string(name) + LIBRARY_EXTENSION);
+	if (!std::filesystem::exists(library))
+	{
+		//Build under a name unique to this process and thread and move it in place once complete, a concurrent
+		//compile of the same scene, possibly by another instance sharing the cache, then never loads a partially
+		//written library
+#ifdef _WIN32
+		unsigned long processId = GetCurrentProcessId();
+#else
+		unsigned long processId = (unsigned long)getpid();
+#endif
+		std::string suffix = std::to_string(processId) + "_" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		std::filesystem::path sourcePath = std::filesystem::path(cacheDirectory) / (std::string(name) + "_" + suffix + ".cpp");
+		std::filesystem::path outputPath = std::filesystem::path(cacheDirectory) / (std::string(name) + "_" + suffix + LIBRARY_EXTENSION);
+
+		{
+			std::ofstream file(sourcePath);
+			file << source;
+		}
+
+		std::string commandLine = command;
+		ReplaceAll(commandLine, "{source}", sourcePath.string());
+		ReplaceAll(commandLine, "{output}", outputPath.string());
+
+		int result = system(commandLine.c_str());
+		std::filesystem::remove(sourcePath, error);
+
+		if (result != 0 || !std::filesystem::exists(outputPath))
+		{
+			std::cout << "Scene compilation failed (" << result << "): " << commandLine << std::endl;
+			return nullptr;
+		}
+
+		std::filesystem::rename(outputPath, library, error);
+		if (error)
+		{
+			std::filesystem::remove(outputPath, error);
+			if (!std::filesystem::exists(library))
+				return nullptr;
+		}
+	}
+
+	std::shared_ptr<SceneModule> module = std::make_shared<SceneModule>();
+#ifdef _WIN32
+	module->library = LoadLibraryA(library.string().c_str());
+	if (!module->library)
+		return nullptr;
+	module->distance = (SceneDistanceFunction)GetProcAddress((HMODULE)module->library, "SceneDistance");
+	module->surface = (SceneSurfaceFunction)GetProcAddress((HMODULE)module->library, "SceneSurface");
+#else
+	module->library = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!module->library)
+	{
+		std::cout << "Scene loading failed: " << dlerror() << std::endl;
+		return nullptr;
+	}
+	module->distance = (SceneDistanceFunction)dlsym(module->library, "SceneDistance");
+	module->surface = (SceneSurfaceFunction)dlsym(module->library, "SceneSurface");
+#endif
+
+	if (!module->distance || !module->surface)
+		return nullptr;
+
+	return module;
+}
+
+std::shared_ptr<SceneModule> SceneCompiler::Compile(Entity* scene)
+{
+	std::string source = GenerateSource(scene);
+	if (source.empty())
+		return nullptr;
+
+	return CompileSource(source);
+}
+
+std::shared_future<std::shared_ptr<SceneModule>> SceneCompiler::CompileAsync(Entity* scene)
+{
+	std::string source = GenerateSource(scene);
+	if (source.empty())
+	{
+		std::promise<std::shared_ptr<SceneModule>> refused;
+		refused.set_value(nullptr);
+		return refused.get_future().share();
+	}
+
+	return std::async(std::launch::async, [this, source]() { return CompileSource(source); }).share();
+}
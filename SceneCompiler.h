@@ -0,0 +1,94 @@
+#pragma once
+#include "common.h"
+#include "Objects.h"
+
+typedef float (*SceneDistanceFunction)(float x, float y, float z);
+typedef float (*SceneSurfaceFunction)(float x, float y, float z, MaterialId* material);
+
+//Native scene functions loaded from a shared library, unloaded with the last entity using them
+struct SceneModule
+{
+	void* library;
+	SceneDistanceFunction distance;
+	SceneSurfaceFunction surface;
+
+	SceneModule() : library(nullptr), distance(nullptr), surface(nullptr) {}
+	SceneModule(const SceneModule&) = delete;
+	SceneModule& operator=(const SceneModule&) = delete;
+	~SceneModule();
+};
+
+//Evaluates the scene through the compiled functions, material blending goes through the entity tree it was
+//compiled from as it only runs at hit points
+struct CompiledEntity : public Entity
+{
+	std::shared_ptr<SceneModule> module;
+	Entity* tree;
+
+	CompiledEntity(std::shared_ptr<SceneModule> module, Entity* tree) :
+		module(module), tree(tree)
+	{}
+
+	virtual Surface CalculateDistanceToSurface(glm::vec3 position) override
+	{
+		Surface surface;
+		surface.distance = module->surface(position.x, position.y, position.z, &surface.material);
+		return surface;
+	}
+
+	virtual float CalculateDistance(glm::vec3 position) override
+	{
+		return module->distance(position.x, position.y, position.z);
+	}
+
+	virtual Material CalculateMaterial(glm::vec3 position, const MaterialTable& materials) override
+	{
+		return tree->CalculateMaterial(position, materials);
+	}
+
+	virtual Entity* Clone(SceneArena& arena) override
+	{
+		return arena.Create<CompiledEntity>(module, tree->Clone(arena));
+	}
+
+	virtual Bounds GetBounds() override
+	{
+		return tree->GetBounds();
+	}
+
+	virtual std::string EmitDistance(SceneCodeWriter& writer, const std::string& position) override
+	{
+		return tree->EmitDistance(writer, position);
+	}
+
+	virtual SurfaceCode EmitSurface(SceneCodeWriter& writer, const std::string& position) override
+	{
+		return tree->EmitSurface(writer, position);
+	}
+};
+
+//Turns an entity tree into specialized C++ (every node inlined, every parameter a constant), builds it with the
+//system compiler and loads the result
+//Libraries are cached by the hash of their source, so an unchanged scene is only built once
+class SceneCompiler
+{
+private:
+	std::string cacheDirectory;
+	std::string command;
+
+	std::shared_ptr<SceneModule> CompileSource(const std::string& source);
+
+public:
+	//The command gets the source and output paths through {source} and {output}
+	SceneCompiler(const std::string& cacheDirectory = "scene_cache", const std::string& command = "");
+
+	//Empty for scenes that animate with time (Oscillate), they are only rendered from the entity tree
+	std::string GenerateSource(Entity* scene);
+
+	//Blocks until the library is built and loaded, returns nullptr when compiling or loading fails or the scene
+	//cannot be compiled
+	std::shared_ptr<SceneModule> Compile(Entity* scene);
+
+	//The source is generated before returning, only building and loading run in the background
+	std::shared_future<std::shared_ptr<SceneModule>> CompileAsync(Entity* scene);
+};
@@ -0,0 +1,59 @@
+#include "Scenes.h"
+
+Entity* CreateRoomScene(SceneArena& arena, MaterialTable& materials)
+{
+	MaterialId white = materials.Add({ glm::vec3(0.9f, 0.999f, 0.999f), 0.9f });
+	MaterialId red = materials.Add({ glm::vec3(0.999f, 0.9f, 0.9f), 0.6f });
+	MaterialId blue = materials.Add({ glm::vec3(0.9f, 0.9f, 0.999f), 0.9f });
+	MaterialId yellow = materials.Add({ glm::vec3(0.999f, 0.999f, 0.9f), 0.9f });
+
+	Entity* root = arena.Create<Union>(std::vector<Entity*>({
+		arena.Create<Sphere>(glm::vec3(0.0f, 0.0f, -12.0f), 7.0f, white),
+		arena.Create<Sphere>(glm::vec3(-1.5f, 0.0f, 0.0f), 1.0f, red),
+		arena.Create<Box>(glm::vec3(20.0f, 0.0f, 0.0f), glm::vec3(0.001f, 5.0f, 5.0f), red),
+		arena.Create<Box>(glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(5.0f, 5.0f, 0.001f), blue),
+		arena.Create<Box>(glm::vec3(-20.0f, 0.0f, 0.0f), glm::vec3(0.001f, 5.0f, 5.0f), yellow),
+		arena.Create<Box>(glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(5.0f, 5.0f, 0.001f), white),
+		arena.Create<Box>(glm::vec3(0.0f, 20.0f, 0.0f), glm::vec3(5.0f, 0.001f, 5.0f), yellow),
+		arena.Create<Box>(glm::vec3(0.0f, -20.0f, 0.0f), glm::vec3(5.0f, 0.001f, 5.0f), white),
+	}));
+
+	return root->Optimize(arena);
+}
+
+std::unique_ptr<Scene> CreateLitRoomScene()
+{
+	std::vector<Light> lights;
+	lights.push_back({ LightType::Directional, glm::normalize(glm::vec3(1.0f, 6.0f, 2.0f)), glm::vec3(0.0f), glm::vec3(0.8f, 0.8f, 0.75f), 8.0f });
+	lights.push_back({ LightType::Point, glm::vec3(0.0f), glm::vec3(2.0f, 3.0f, -2.0f), glm::vec3(6.0f, 5.0f, 4.0f), 16.0f });
+
+	SceneArena arena;
+	MaterialTable materials;
+	Entity* root = CreateRoomScene(arena, materials);
+
+	return std::make_unique<Scene>(root, materials, lights, glm::vec3(0.25f, 0.25f, 0.3f));
+}
+
+Camera CreateRoomCamera(float fov)
+{
+	glm::mat4 matrix(1.0f);
+	matrix = glm::rotate(matrix, 0.7f, glm::vec3(0.0f, 1.0f, 0.0f));
+	matrix = glm::rotate(matrix, 0.48f, glm::vec3(1.0f, 0.0f, 0.0f));
+
+	return Camera(glm::vec3(-6.0f, 3.0f, -6.0f), glm::mat3(matrix), fov);
+}
+
+Entity* CreateInteractiveScene(SceneArena& arena, MaterialTable& materials, const float* time)
+{
+	MaterialId pink = materials.Add({ glm::vec3(0.8f, 0.6f, 0.6f), 0.9f });
+	MaterialId grey = materials.Add({ glm::vec3(0.8f, 0.8f, 0.8f), 0.9f });
+	MaterialId blue = materials.Add({ glm::vec3(0.6f, 0.6f, 0.8f), 0.9f });
+
+	Entity* donut = arena.Create<Torus>(glm::vec3(0.0f), glm::vec2(1.0f, 0.5f), pink);
+	Entity* slab = arena.Create<Box>(glm::vec3(0.0f, -2.5f, 0.0f), glm::vec3(10.0f, 0.5f, 10.0f), grey);
+	Entity* blob = arena.Create<Oscillate>(arena.Create<Sphere>(glm::vec3(0.0f), 0.5f, blue), glm::vec3(6.0f, 1.0f, 0.0f), 0.5f, time);
+
+	Entity* root = arena.Create<CubicSmoothUnion>(arena.Create<Union>(donut, slab), blob, 2.0f);
+
+	return root->Optimize(arena);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "common.h"
+#include "Objects.h"
+#include "Scene.h"
+#include "Camera.h"
+
+//Scenes shared by the CPU renderer and the shaders, each returns its optimized root, allocated in the arena
+
+//Two spheres inside a room of thin walls
+Entity* CreateRoomScene(SceneArena& arena, MaterialTable& materials);
+
+//The animated fs.glsl scene, a donut on a slab with a blob swinging through both, time is in seconds
+Entity* CreateInteractiveScene(SceneArena& arena, MaterialTable& materials, const float* time);
+
+//The room lit by a sun and a warm point light, ready to render
+std::unique_ptr<Scene> CreateLitRoomScene();
+
+//Looks into the room from a corner, fov is half the vertical field of view
+Camera CreateRoomCamera(float fov);
@@ -0,0 +1,108 @@
+#include "ShaderEmulator.h"
+
+//Hit threshold growth per unit of depth in pixels, see CastRay in fs.glsl
+#define PRIMARY_HIT_FOOTPRINT 0.5f
+#define SECONDARY_HIT_FOOTPRINT 0.125f
+
+ShaderFrame GetInteractiveFrame(float time, glm::uvec2 size)
+{
+	ShaderFrame frame;
+	frame.time = time;
+	frame.aspectRatio = (float)size.x / (float)size.y;
+	frame.fovFactor = 1.0f / tan(3.1415f / 7.0f);
+	frame.pixelAngle = 2.0f / ((float)size.y * frame.fovFactor);
+	frame.cameraPosition = glm::vec3(sin(time / 2.0f) * 7.0f, 4.0f, cos(time / 2.0f) * -7.0f);
+
+	glm::mat4 matrix(1.0f);
+	matrix = glm::rotate(matrix, -time / 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+	matrix = glm::rotate(matrix, 0.4f, glm::vec3(1.0f, 0.0f, 0.0f));
+	frame.cameraMatrix = glm::mat3(matrix);
+
+	return frame;
+}
+
+ShaderEmulator::ShaderEmulator(ThreadPool& threadPool)
+	: threadPool(threadPool), time(0.0f), stepCount(0)
+{
+	scene = CreateInteractiveScene(arena, materials, &time);
+}
+
+glm::vec3 ShaderEmulator::GetNormal(glm::vec3 position, float distance)
+{
+	return glm::normalize((glm::vec3(
+		scene->CalculateDistance(position + glm::vec3(0.0001f, 0.0f, 0.0f)),
+		scene->CalculateDistance(position + glm::vec3(0.0f, 0.0001f, 0.0f)),
+		scene->CalculateDistance(position + glm::vec3(0.0f, 0.0f, 0.0001f))
+	) - distance) / 0.0001f);
+}
+
+bool ShaderEmulator::CastRay(glm::vec3 origin, glm::vec3 direction, float footprint, ShaderHit& hit, uint32_t& steps)
+{
+	float depth = 0.0f;
+	for (uint32_t step = 0; step < 100; step++)
+	{
+		glm::vec3 position = origin + direction * depth;
+		float distance = scene->CalculateDistance(position);
+		steps++;
+
+		if (distance < glm::max(0.001f, footprint * depth))
+		{
+			hit.position = position;
+			hit.normal = GetNormal(position, distance);
+			hit.material = scene->CalculateMaterial(position, materials);
+			return true;
+		}
+
+		depth += distance;
+
+		if (depth >= 200.0f)
+			break;
+	}
+
+	//Misses and rays running out of steps both end on the sky
+	hit.material = { glm::vec3(0.9f, 0.9f, 0.9f), 0.0f };
+	return false;
+}
+
+glm::vec3 ShaderEmulator::CastCameraRay(glm::vec3 origin, glm::vec3 direction, float pixelAngle, uint32_t& steps)
+{
+	glm::vec3 color = glm::vec3(0.9f, 0.9f, 0.9f);
+
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		ShaderHit hit;
+		CastRay(origin, direction, (i == 0 ? PRIMARY_HIT_FOOTPRINT : SECONDARY_HIT_FOOTPRINT) * pixelAngle, hit, steps);
+
+		color *= hit.material.color;
+
+		if (hit.material.reflectivity > 0.001f)
+		{
+			direction = glm::reflect(direction, hit.normal);
+			origin = hit.position + direction * 0.001f;
+		}
+		else
+			break;
+	}
+
+	return color;
+}
+
+void ShaderEmulator::Render(const ShaderFrame& frame, glm::uvec2 size, glm::vec3* pixels)
+{
+	time = frame.time;
+	stepCount = 0;
+
+	//One task per row, rows are cheap enough that finer tasks only add overhead
+	threadPool.ParallelFor(size.y, [this, &frame, size, pixels](uint32_t y) {
+		uint32_t steps = 0;
+		for (uint32_t x = 0; x < size.x; x++)
+		{
+			//Interpolated gl_Position.xy at the pixel center, as vs.glsl passes it on
+			glm::vec2 screenCoord = (glm::vec2(x, y) + 0.5f) / glm::vec2(size) * 2.0f - 1.0f;
+			glm::vec3 direction = glm::normalize(frame.cameraMatrix * glm::vec3(screenCoord.x * frame.aspectRatio, screenCoord.y, frame.fovFactor));
+
+			pixels[y * size.x + x] = CastCameraRay(frame.cameraPosition, direction, frame.pixelAngle, steps);
+		}
+		stepCount += steps;
+	});
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "common.h"
+#include "Objects.h"
+#include "ThreadPool.h"
+#include "Scenes.h"
+
+//Camera and clock of one fs.glsl frame, the values its uniforms receive
+struct ShaderFrame
+{
+	float time; //Seconds
+	float aspectRatio;
+	float fovFactor; //1 / tan(fov / 2)
+	float pixelAngle; //2 / (height * fovFactor)
+	glm::vec3 cameraPosition;
+	glm::mat3 cameraMatrix;
+};
+
+//The camera orbiting the interactive scene, main.cpp feeds the same values to the shader
+ShaderFrame GetInteractiveFrame(float time, glm::uvec2 size);
+
+//CPU port of fs.glsl (CastCameraRay, CastRay, GetNormal) rendering the interactive scene on the thread pool,
+//so shader changes can be profiled and image-diffed without a GPU
+//Constants and the order of operations follow the shader, keep both in sync
+class ShaderEmulator
+{
+private:
+	struct ShaderHit
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		Material material;
+	};
+
+	ThreadPool& threadPool;
+
+	SceneArena arena;
+	MaterialTable materials;
+	float time;
+	Entity* scene;
+
+	std::atomic<uint64_t> stepCount;
+
+	glm::vec3 GetNormal(glm::vec3 position, float distance);
+	bool CastRay(glm::vec3 origin, glm::vec3 direction, float footprint, ShaderHit& hit, uint32_t& steps);
+	glm::vec3 CastCameraRay(glm::vec3 origin, glm::vec3 direction, float pixelAngle, uint32_t& steps);
+
+public:
+	ShaderEmulator(ThreadPool& threadPool = ThreadPool::GetShared());
+
+	//Pixels are stored bottom row first like a GL framebuffer, one Render call at a time
+	void Render(const ShaderFrame& frame, glm::uvec2 size, glm::vec3* pixels);
+
+	//Number of distance evaluations made by march steps during the last Render call
+	uint64_t GetStepCount() const { return stepCount; }
+};
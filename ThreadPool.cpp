@@ -0,0 +1,80 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+	: stopping(false)
+{
+	for (uint32_t i = 0; i < threadCount; i++)
+		threads.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void ThreadPool::Work()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+			if (tasks.empty())
+				return;
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task)
+{
+	std::shared_ptr<std::packaged_task<void()>> packagedTask = std::make_shared<std::packaged_task<void()>>(std::move(task));
+	std::future<void> future = packagedTask->get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back([packagedTask]() { (*packagedTask)(); });
+	}
+	condition.notify_one();
+
+	return future;
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& function)
+{
+	std::atomic<uint32_t> next(0);
+	auto run = [&next, count, &function]() {
+		for (uint32_t index = next++; index < count; index = next++)
+			function(index);
+	};
+
+	std::vector<std::future<void>> helpers;
+	uint32_t helperCount = glm::min(GetThreadCount(), count > 0 ? count - 1 : 0);
+	for (uint32_t i = 0; i < helperCount; i++)
+		helpers.push_back(Submit(run));
+
+	run();
+
+	for (std::future<void>& helper : helpers)
+		helper.get();
+}
+
+ThreadPool& ThreadPool::GetShared()
+{
+	static ThreadPool threadPool;
+	return threadPool;
+}
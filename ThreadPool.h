@@ -0,0 +1,30 @@
+#pragma once
+#include "common.h"
+
+//Fixed set of worker threads shared by every renderer of the process
+class ThreadPool
+{
+private:
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+
+	void Work();
+
+public:
+	ThreadPool(uint32_t threadCount = glm::max(std::thread::hardware_concurrency(), 1u));
+	~ThreadPool();
+
+	std::future<void> Submit(std::function<void()> task);
+
+	//Calls function for every index in [0, count) and returns once all calls are done, the calling thread takes part
+	//Must not be called from inside a pool task
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& function);
+
+	uint32_t GetThreadCount() const { return (uint32_t)threads.size(); }
+
+	static ThreadPool& GetShared();
+};
@@ -0,0 +1,85 @@
+#include "Upscaler.h"
+
+#define UPSCALE_BAND_HEIGHT 16
+
+//Source pixels and weights of one output column or row
+struct UpscaleTaps
+{
+	int32_t index[4]; //Clamped to the image
+	float weight[4];
+};
+
+static std::vector<UpscaleTaps> GetUpscaleTaps(uint32_t sourceSize, uint32_t size)
+{
+	std::vector<UpscaleTaps> taps(size);
+	float scale = (float)sourceSize / (float)size;
+	for (uint32_t i = 0; i < size; i++)
+	{
+		//Pixel centers line up, not pixel corners
+		float position = ((float)i + 0.5f) * scale - 0.5f;
+		float first = floorf(position);
+		float t = position - first, t2 = t * t, t3 = t2 * t;
+
+		taps[i].weight[0] = -0.5f * t3 + t2 - 0.5f * t;
+		taps[i].weight[1] = 1.5f * t3 - 2.5f * t2 + 1.0f;
+		taps[i].weight[2] = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+		taps[i].weight[3] = 0.5f * t3 - 0.5f * t2;
+
+		for (int32_t j = 0; j < 4; j++)
+			taps[i].index[j] = glm::clamp((int32_t)first - 1 + j, 0, (int32_t)sourceSize - 1);
+	}
+	return taps;
+}
+
+void UpscaleImage(ThreadPool& threadPool, glm::uvec2 sourceSize, const glm::vec3* source, glm::uvec2 size, glm::vec3* pixels)
+{
+	const std::vector<UpscaleTaps> columns = GetUpscaleTaps(sourceSize.x, size.x);
+	const std::vector<UpscaleTaps> rows = GetUpscaleTaps(sourceSize.y, size.y);
+
+	//The horizontal pass only runs over the source rows, the vertical pass reads them
+	std::vector<glm::vec3> horizontal((size_t)sourceSize.y * size.x);
+
+	uint32_t bandCount = (sourceSize.y + UPSCALE_BAND_HEIGHT - 1) / UPSCALE_BAND_HEIGHT;
+	threadPool.ParallelFor(bandCount, [&](uint32_t band) {
+		uint32_t bottom = glm::min((band + 1) * UPSCALE_BAND_HEIGHT, sourceSize.y);
+		for (uint32_t y = band * UPSCALE_BAND_HEIGHT; y < bottom; y++)
+		{
+			const glm::vec3* sourceRow = source + (size_t)y * sourceSize.x;
+			glm::vec3* row = &horizontal[(size_t)y * size.x];
+			for (uint32_t x = 0; x < size.x; x++)
+			{
+				const UpscaleTaps& taps = columns[x];
+				row[x] = sourceRow[taps.index[0]] * taps.weight[0] + sourceRow[taps.index[1]] * taps.weight[1] +
+					sourceRow[taps.index[2]] * taps.weight[2] + sourceRow[taps.index[3]] * taps.weight[3];
+			}
+		}
+	});
+
+	bandCount = (size.y + UPSCALE_BAND_HEIGHT - 1) / UPSCALE_BAND_HEIGHT;
+	threadPool.ParallelFor(bandCount, [&](uint32_t band) {
+		uint32_t bottom = glm::min((band + 1) * UPSCALE_BAND_HEIGHT, size.y);
+		for (uint32_t y = band * UPSCALE_BAND_HEIGHT; y < bottom; y++)
+		{
+			const UpscaleTaps& taps = rows[y];
+			const glm::vec3* row0 = &horizontal[(size_t)taps.index[0] * size.x];
+			const glm::vec3* row1 = &horizontal[(size_t)taps.index[1] * size.x];
+			const glm::vec3* row2 = &horizontal[(size_t)taps.index[2] * size.x];
+			const glm::vec3* row3 = &horizontal[(size_t)taps.index[3] * size.x];
+			const glm::vec3* sourceRow1 = source + (size_t)taps.index[1] * sourceSize.x;
+			const glm::vec3* sourceRow2 = source + (size_t)taps.index[2] * sourceSize.x;
+
+			glm::vec3* row = pixels + (size_t)y * size.x;
+			for (uint32_t x = 0; x < size.x; x++)
+			{
+				glm::vec3 color = row0[x] * taps.weight[0] + row1[x] * taps.weight[1] + row2[x] * taps.weight[2] + row3[x] * taps.weight[3];
+
+				//The negative lobes overshoot at edges, so the result stays within its nearest source pixels
+				int32_t left = columns[x].index[1], right = columns[x].index[2];
+				glm::vec3 low = glm::min(glm::min(sourceRow1[left], sourceRow1[right]), glm::min(sourceRow2[left], sourceRow2[right]));
+				glm::vec3 high = glm::max(glm::max(sourceRow1[left], sourceRow1[right]), glm::max(sourceRow2[left], sourceRow2[right]));
+
+				row[x] = glm::clamp(color, low, high);
+			}
+		}
+	});
+}
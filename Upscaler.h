@@ -0,0 +1,7 @@
+#pragma once
+#include "common.h"
+#include "ThreadPool.h"
+
+//Separable Catmull-Rom filter (4x4 taps, sharper than bilinear), each result is clamped to the range of the 2x2
+//source pixels around it so edges do not ring. Rows are split in bands across the thread pool
+void UpscaleImage(ThreadPool& threadPool, glm::uvec2 sourceSize, const glm::vec3* source, glm::uvec2 size, glm::vec3* pixels);
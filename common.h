@@ -1,11 +1,20 @@
 #pragma once
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <memory>
 #include <fstream>
 #include <future>
 #include <functional>
 #include <mutex>
 #include <shared_mutex>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <condition_variable>
+#include <cfloat>
+#include <cassert>
 
 #include <gl/glew.h>
 #include <glfw/glfw3.h>
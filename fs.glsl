@@ -9,6 +9,7 @@ in vec2 screenCoord;
 uniform float time;
 uniform float aspectRatio;
 uniform float fovFactor; // 1.0f / tan(fov / 2.0f)
+uniform float pixelAngle; // 2.0f / (height * fovFactor), angle covered by one pixel
 uniform vec3 cameraPosition;
 uniform mat3 cameraMatrix;
 
@@ -32,98 +33,8 @@ struct Hit
 	vec3 direction;
 };
 
-float SDToSphere(vec3 position, vec3 center, float radius)
-{
-	return length(position - center) - radius;
-}
-Material SDToSphereMaterial(vec3 position, vec3 center, float radius, vec3 color, float reflection)
-{
-	return Material(
-		length(position - center) - radius,
-		color,
-		reflection,
-		vec3(0.0f, 0.0f, 0.0f)
-	);
-}
-float SDToBox(vec3 position, vec3 center, vec3 extents)
-{
-	vec3 q = abs(position - center) - extents;
-	return length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)),0.0);
-}
-Material SDToBoxMaterial(vec3 position, vec3 center, vec3 extents, vec3 color, float reflection)
-{
-	vec3 q = abs(position - center) - extents;
-	return Material(
-		length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)),0.0),
-		color,
-		reflection,
-		vec3(0.0f, 0.0f, 0.0f)
-	);
-}
-float SDToDonut(vec3 position, vec2 torus)
-{
-	vec2 q = vec2(length(position.xz)-torus.x,position.y);
-	return length(q)-torus.y;
-}
-Material SDToDonutMaterial(vec3 position, vec2 torus, vec3 color, float reflection)
-{
-	vec2 q = vec2(length(position.xz)-torus.x,position.y);
-	return Material(
-		length(q)-torus.y,
-		color,
-		reflection,
-		vec3(0.0f, 0.0f, 0.0f)
-	);
-}
-
-float sdTorus( vec3 p, vec2 t )
-{
-  vec2 q = vec2(length(p.xz)-t.x,p.y);
-  return length(q)-t.y;
-}
-
-float SDToUnion(float object1, float object2)
-{
-	return min(object1, object2);
-}
-Material SDToUnionMaterial(Material object1, Material object2)
-{
-	if (object1.distance < object2.distance)
-		return object1;
-	else
-		return object2;
-}
-float SDToSmoothUnion(float object1, float object2, float k)
-{
-    float h = max( k-abs(object1-object2), 0.0 )/k;
-    return min( object1, object2 ) - h*h*h*k*(1.0/6.0);
-}
-Material SDToSmoothUnionMaterial(Material object1, Material object2, float k)
-{
-	if (object1.distance < object2.distance)
-		return object1;
-	else
-		return object2;
-}
-
-float SDToScene(vec3 position)
-{
-	float box = SDToDonut(position, vec2(1.0f, 0.5f));
-	float plane = SDToBox(position, vec3(0.0f, -2.5f, 0.0f), vec3(10.0f, 0.5f, 10.0f));
-
-	float blob = SDToSphere(position, vec3(sin(time / 2.0f) * 6.0f, sin(time / 2.0f), 0.0f), 0.5f);
-	
-	return SDToSmoothUnion(SDToUnion(box, plane), blob, 2.0f);
-}
-Material SDToSceneMaterial(vec3 position)
-{
-	Material box = SDToDonutMaterial(position, vec2(1.0f, 0.5f), vec3(0.8f, 0.6f, 0.6f), 0.9f);
-	Material plane = SDToBoxMaterial(position,  vec3(0.0f, -2.5f, 0.0f), vec3(10.0f, 0.5f, 10.0f), vec3(0.8f, 0.8f, 0.8f), 0.9f);
-
-	Material blob = SDToSphereMaterial(position, vec3(sin(time / 2.0f) * 6.0f, 0.0f, 0.0f), 0.5f, vec3(0.6f, 0.6f, 0.8f), 0.9f);
-	
-	return SDToUnionMaterial(SDToUnionMaterial(box, plane), blob);
-}
+//SDToScene and SDToSceneMaterial, generated from the scene's entity tree (GenerateShaderScene)
+#pragma scene
 
 vec3 GetNormal(vec3 position, float distance)
 {
@@ -134,7 +45,11 @@ vec3 GetNormal(vec3 position, float distance)
 	) - distance) / 0.0001f);
 }
 
-Hit CastRay(vec3 origin, vec3 direction)
+// A hit is accepted once the distance is below the ray's cone width at its depth (footprint * depth), 0.001f near the origin
+#define PRIMARY_HIT_FOOTPRINT 0.5f
+#define SECONDARY_HIT_FOOTPRINT 0.125f
+
+Hit CastRay(vec3 origin, vec3 direction, float footprint)
 {
 	float depth = 0.0f;
 	for(uint steps = 0; steps < 100; steps++)
@@ -142,7 +57,7 @@ Hit CastRay(vec3 origin, vec3 direction)
 		vec3 position = origin + direction * depth;
 		float distance = SDToScene(position);
 
-		if(distance < 0.001f)
+		if(distance < max(0.001f, footprint * depth))
 		{
 			Material material = SDToSceneMaterial(position);
 			material.normal = GetNormal(position, distance);
@@ -175,7 +90,7 @@ vec3 CastCameraRay(vec3 origin, vec3 direction)
 
 	for(int i = 0; i < 6; i++)
 	{
-		Hit hit = CastRay(origin, direction);
+		Hit hit = CastRay(origin, direction, (i == 0 ? PRIMARY_HIT_FOOTPRINT : SECONDARY_HIT_FOOTPRINT) * pixelAngle);
 
 		color *= hit.material.color;
 
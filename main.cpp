@@ -1,13 +1,16 @@
 #include "common.h"
 #include <chrono>
 #include "RayMarcher.h"
+#include "SceneCodeWriter.h"
+#include "ShaderEmulator.h"
 
 #define IMAGE_SIZE_X 240
 //#define IMAGE_SIZE_X 1920
 #define IMAGE_SIZE_Y 135
 //#define IMAGE_SIZE_Y 1080
 
-uint32_t CompileShaderFromFile(uint32_t shaderType, std::string filename)
+//The scene code, if any, replaces the "#pragma scene" line of the file
+uint32_t CompileShaderFromFile(uint32_t shaderType, std::string filename, const std::string& scene = "")
 {
 	std::ifstream file(filename);
 	if (!file.is_open())
@@ -24,6 +27,8 @@ uint32_t CompileShaderFromFile(uint32_t shaderType, std::string filename)
 		return 0;
 	}
 
+	source = InsertShaderScene(source, scene);
+
 	uint32_t shader = glCreateShader(shaderType);
 	char* sourcec = (char*)source.c_str();
 	glShaderSource(shader, 1, &sourcec, nullptr);
@@ -86,6 +91,7 @@ struct FragmetShaderUniforms
 	uint32_t time;
 	uint32_t aspectRatio;
 	uint32_t fovFactor;
+	uint32_t pixelAngle;
 	uint32_t cameraPosition;
 	uint32_t cameraMatrix;
 } fragShaderUniforms;
@@ -94,17 +100,73 @@ std::mutex mutex;
 std::atomic_bool changed = false;
 glm::vec3* pixels2;
 
-void Update(glm::vec3* pixels, glm::uvec2 size)
+void Update(const glm::vec3* pixels, glm::uvec2 size, glm::uvec2 regionMin, glm::uvec2 regionMax)
 {
 	mutex.lock();
 
-	memcpy(pixels2, pixels, size.x * size.y);
+	for (uint32_t y = regionMin.y; y < regionMax.y; y++)
+		memcpy(pixels2 + y * size.x + regionMin.x, pixels + y * size.x + regionMin.x, (regionMax.x - regionMin.x) * sizeof(glm::vec3));
 	changed = true;
 	mutex.unlock();
 }
 
-int main()
+//Binary PPM, top row first
+bool WriteImage(const std::string& filename, glm::uvec2 size, const glm::vec3* pixels)
 {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		printf("Failed to open file : %s\n", filename.c_str());
+		return false;
+	}
+
+	file << "P6\n" << size.x << " " << size.y << "\n255\n";
+	for (uint32_t y = size.y; y-- > 0;)
+	{
+		for (uint32_t x = 0; x < size.x; x++)
+		{
+			glm::vec3 color = glm::clamp(pixels[y * size.x + x], 0.0f, 1.0f) * 255.0f + 0.5f;
+			char rgb[3] = { (char)(uint8_t)color.r, (char)(uint8_t)color.g, (char)(uint8_t)color.b };
+			file.write(rgb, 3);
+		}
+	}
+
+	return true;
+}
+
+//Headless: renders the fs.glsl frame at the given time on the CPU
+//Usage : --emulate [time] [width] [height] [output.ppm]
+int EmulateShader(int argc, char** argv)
+{
+	float time = argc > 2 ? (float)atof(argv[2]) : 0.0f;
+	glm::uvec2 size = glm::uvec2(argc > 3 ? atoi(argv[3]) : 1920, argc > 4 ? atoi(argv[4]) : 1080);
+	std::string filename = argc > 5 ? argv[5] : "frame.ppm";
+
+	if (size.x == 0 || size.y == 0)
+	{
+		printf("Invalid image size : %u x %u\n", size.x, size.y);
+		return -1;
+	}
+
+	std::vector<glm::vec3> pixels(size.x * size.y);
+	ShaderEmulator emulator;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	emulator.Render(GetInteractiveFrame(time, size), size, pixels.data());
+	auto end = std::chrono::high_resolution_clock::now();
+
+	printf("Rendered %u x %u at t = %.3f s in %.2f ms, %llu steps (%.2f per pixel)\n", size.x, size.y, time,
+		std::chrono::duration<double, std::milli>(end - start).count(),
+		(unsigned long long)emulator.GetStepCount(), (double)emulator.GetStepCount() / (double)(size.x * size.y));
+
+	return WriteImage(filename, size, pixels.data()) ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && std::string(argv[1]) == "--emulate")
+		return EmulateShader(argc, argv);
+
 	GLFWwindow* window;
 
 	if (!glfwInit())
@@ -114,7 +176,6 @@ int main()
 	glfwWindowHint(GLFW_DOUBLEBUFFER, GL_TRUE);
 
 	const int32_t windowWidth = 1920, windowHeight = 1080;
-	const float aspectRatio = (float)windowWidth / (float)windowHeight;
 	//window = glfwCreateWindow(windowWidth, windowHeight, "Ray Tracing", glfwGetPrimaryMonitor(), nullptr);
 	window = glfwCreateWindow(windowWidth, windowHeight, "Ray Tracing", nullptr, nullptr);
 	if (!window)
@@ -128,10 +189,15 @@ int main()
 	if (glewInit() != GLEW_OK)
 		return -1;
 
-	//Create shader
+	//Create shader, the scene is animated by the time uniform so it is only generated once
+	SceneArena sceneArena;
+	MaterialTable sceneMaterials;
+	float sceneTime = 0.0f;
+	Entity* scene = CreateInteractiveScene(sceneArena, sceneMaterials, &sceneTime);
+
 	uint32_t program = CreateProgram(
 		CompileShaderFromFile(GL_VERTEX_SHADER, "vs.glsl"),
-		CompileShaderFromFile(GL_FRAGMENT_SHADER, "fs.glsl")
+		CompileShaderFromFile(GL_FRAGMENT_SHADER, "fs.glsl", GenerateShaderScene(scene, sceneMaterials, SceneLanguage::Glsl))
 	);
 	if (!program)
 		return -1;
@@ -139,7 +205,7 @@ int main()
 	fragShaderUniforms.time = glGetUniformLocation(program, "time");
 	fragShaderUniforms.aspectRatio = glGetUniformLocation(program, "aspectRatio");
 	fragShaderUniforms.fovFactor = glGetUniformLocation(program, "fovFactor");
-	const float fovFactor = 1.0f / tan(3.1415f / 7.0f);
+	fragShaderUniforms.pixelAngle = glGetUniformLocation(program, "pixelAngle");
 
 	fragShaderUniforms.cameraPosition = glGetUniformLocation(program, "cameraPosition");
 	fragShaderUniforms.cameraMatrix = glGetUniformLocation(program, "cameraMatrix");
@@ -196,11 +262,14 @@ int main()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	//glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, IMAGE_SIZE_X, IMAGE_SIZE_Y);
 
-	//RayMarcher rayMarcher = RayMarcher(glm::uvec2(IMAGE_SIZE_X, IMAGE_SIZE_Y), 3.1415f / 4.0f);
-	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IMAGE_SIZE_X, IMAGE_SIZE_Y, 0, GL_RGB, GL_FLOAT, rayMarcher.Render());
+	//std::unique_ptr<Scene> scene = CreateLitRoomScene();
+	//Camera camera = CreateRoomCamera(3.1415f / 4.0f);
+	//RenderTarget target(glm::uvec2(IMAGE_SIZE_X, IMAGE_SIZE_Y));
+	//RayMarcher rayMarcher;
+	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, IMAGE_SIZE_X, IMAGE_SIZE_Y, 0, GL_RGB, GL_FLOAT, rayMarcher.Render(*scene, camera, target));
 	//pixels2 = new glm::vec3[IMAGE_SIZE_X * IMAGE_SIZE_Y];
-	//std::future<void> async = rayMarcher.AsyncRender(std::bind(&Update, std::placeholders::_1, std::placeholders::_2), 32);
-	//async.wait();
+	//std::unique_ptr<RenderHandle> async = rayMarcher.AsyncRender(*scene, camera, target, Update, 32);
+	//async->Wait();
 
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -216,22 +285,15 @@ int main()
 		time += time2 - time1;
 		time1 = time2;
 
-		glUniform1f(fragShaderUniforms.time, time / 1000.0f);
-		glUniform1f(fragShaderUniforms.aspectRatio, aspectRatio);
-		glUniform1f(fragShaderUniforms.fovFactor, fovFactor);
-
-		glm::vec3 position = glm::vec3(sin(time / 2000.0f) * 7.0f, 4.0f, cos(time / 2000.0f) * -7.0f);
-
-		glUniform3fv(fragShaderUniforms.cameraPosition, 1, glm::value_ptr(position));
-
-		glm::mat4 matrix(1.0f);
-		matrix = glm::rotate(matrix, -time / 2000.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-		matrix = glm::rotate(matrix, 0.4f, glm::vec3(1.0f, 0.0f, 0.0f));
-
-		glUniformMatrix3fv(fragShaderUniforms.cameraMatrix, 1, false, glm::value_ptr(
-			glm::mat3(matrix)
+		//Same camera as the CPU emulation renders, so frames can be compared
+		ShaderFrame frame = GetInteractiveFrame(time / 1000.0f, glm::uvec2(windowWidth, windowHeight));
 
-		));
+		glUniform1f(fragShaderUniforms.time, frame.time);
+		glUniform1f(fragShaderUniforms.aspectRatio, frame.aspectRatio);
+		glUniform1f(fragShaderUniforms.fovFactor, frame.fovFactor);
+		glUniform1f(fragShaderUniforms.pixelAngle, frame.pixelAngle);
+		glUniform3fv(fragShaderUniforms.cameraPosition, 1, glm::value_ptr(frame.cameraPosition));
+		glUniformMatrix3fv(fragShaderUniforms.cameraMatrix, 1, false, glm::value_ptr(frame.cameraMatrix));
 
 		//glBindTexture(GL_TEXTURE_2D, image);
 		/*if (changed)
@@ -0,0 +1,164 @@
+#include "../common.h"
+#include "../RayMarcher.h"
+#include "../DynamicResolution.h"
+#include "../Scenes.h"
+
+//Checks of the CPU renderer that need no GPU, exits with the number of failed cases
+
+struct TestCase
+{
+	const char* name;
+	bool (*run)();
+};
+
+//A render cancelled before its first tile must not trace the frame, the worker may pick the handle up before or after
+//the cancellation so both orders get a few tries
+static bool CancelBeforeFirstTile()
+{
+	std::unique_ptr<Scene> scene = CreateLitRoomScene();
+	Camera camera = CreateRoomCamera(3.1415f / 4.0f);
+	RayMarcher rayMarcher;
+	RenderTarget target(glm::uvec2(480, 270));
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		std::atomic<uint32_t> frameUpdates(0);
+		std::unique_ptr<RenderHandle> handle = rayMarcher.AsyncRender(*scene, camera, target,
+			[&frameUpdates](const glm::vec3*, glm::uvec2 size, glm::uvec2 regionMin, glm::uvec2 regionMax) {
+				if (regionMin == glm::uvec2(0, 0) && regionMax == size)
+					frameUpdates++;
+			});
+
+		handle->Cancel();
+		handle->Wait();
+
+		if (handle->GetStatus() != RenderStatus::Cancelled || frameUpdates > 0)
+			return false;
+		if (handle->GetTileCount() > 0 && handle->GetCompletedTiles() == handle->GetTileCount())
+			return false;
+	}
+
+	//Destroying the handle cancels it the same way
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		std::atomic<uint32_t> frameUpdates(0);
+		rayMarcher.AsyncRender(*scene, camera, target,
+			[&frameUpdates](const glm::vec3*, glm::uvec2 size, glm::uvec2 regionMin, glm::uvec2 regionMax) {
+				if (regionMin == glm::uvec2(0, 0) && regionMax == size)
+					frameUpdates++;
+			});
+
+		if (frameUpdates > 0)
+			return false;
+	}
+
+	return true;
+}
+
+//Squared difference between the image and the reference moved by offset, over the pixels within band of the rectangle
+//from regionMin up to regionMax but outside it
+static double GetBandError(const glm::vec3* pixels, const glm::vec3* reference, glm::uvec2 size, glm::uvec2 regionMin,
+	glm::uvec2 regionMax, int32_t band, glm::ivec2 offset)
+{
+	double error = 0.0;
+	uint32_t count = 0;
+	glm::ivec2 bandMin = glm::max(glm::ivec2(regionMin) - band, glm::ivec2(0, 0));
+	glm::ivec2 bandMax = glm::min(glm::ivec2(regionMax) + band, glm::ivec2(size));
+	for (int32_t y = bandMin.y; y < bandMax.y; y++)
+	{
+		for (int32_t x = bandMin.x; x < bandMax.x; x++)
+		{
+			bool inside = x >= (int32_t)regionMin.x && x < (int32_t)regionMax.x && y >= (int32_t)regionMin.y && y < (int32_t)regionMax.y;
+			glm::ivec2 source = glm::ivec2(x, y) + offset;
+			if (inside || source.x < 0 || source.y < 0 || source.x >= (int32_t)size.x || source.y >= (int32_t)size.y)
+				continue;
+
+			glm::vec3 difference = pixels[y * size.x + x] - reference[source.y * size.x + source.x];
+			error += glm::dot(difference, difference);
+			count++;
+		}
+	}
+
+	return count > 0 ? error / count : 0.0;
+}
+
+//A lit sphere filling the view, its shading is smooth everywhere so an upscale of it is close to exact once the
+//samples line up
+static std::unique_ptr<Scene> CreateSmoothScene(SceneArena& arena, MaterialTable& materials)
+{
+	MaterialId white = materials.Add({ glm::vec3(0.9f, 0.9f, 0.9f), 0.0f });
+	Entity* root = arena.Create<Sphere>(glm::vec3(0.0f), 1.0f, white)->Optimize(arena);
+
+	std::vector<Light> lights;
+	lights.push_back({ LightType::Directional, glm::normalize(glm::vec3(1.0f, 0.5f, -1.0f)), glm::vec3(0.0f), glm::vec3(1.0f), 8.0f });
+
+	return std::make_unique<Scene>(root, materials, lights, glm::vec3(0.1f));
+}
+
+//The fovea is rendered again at the output resolution, the pixels around it come from the upscaled internal frame, if
+//the two sample grids are shifted against each other the border shows as a seam
+//Next to the fovea the upscaled frame must match the scale 1 frame clearly better in place than moved by a pixel
+static bool FoveaBorderAlignment()
+{
+	SceneArena arena;
+	MaterialTable materials;
+	std::unique_ptr<Scene> scene = CreateSmoothScene(arena, materials);
+	Camera camera(glm::vec3(0.0f, 0.0f, -1.5f), glm::mat3(1.0f), 3.1415f / 8.0f);
+
+	RayMarcher rayMarcher;
+	rayMarcher.GetSettings().antiAliasing = false;
+	rayMarcher.GetSettings().ambientOcclusion = false;
+
+	glm::uvec2 size(480, 272);
+	RenderTarget reference(size);
+	rayMarcher.Render(*scene, camera, reference);
+
+	DynamicResolutionSettings settings;
+	settings.minScale = settings.maxScale = 0.5f;
+	settings.foveation = true;
+	DynamicResolutionView view(rayMarcher, size, settings);
+	const glm::vec3* pixels = view.Render(*scene, camera);
+	if (view.GetInternalSize() != size / 2u)
+		return false;
+
+	//RenderRegion renders whole tiles of its default batch size around the fovea
+	const uint32_t tileSize = 32;
+	glm::vec2 center = settings.foveaCenter * glm::vec2(size);
+	glm::vec2 radius = glm::vec2(settings.foveaRadius * (float)size.y);
+	glm::uvec2 regionMin = glm::uvec2(center - radius) / tileSize * tileSize;
+	glm::uvec2 regionMax = glm::min((glm::uvec2(center + radius) + tileSize - 1u) / tileSize * tileSize, size);
+
+	//Lined up, moving by a pixel about doubles the error along either axis, shifted grids match better moved one way
+	const int32_t band = 8;
+	double error = GetBandError(pixels, reference.pixels.data(), size, regionMin, regionMax, band, glm::ivec2(0, 0));
+	const glm::ivec2 offsets[] = { glm::ivec2(1, 0), glm::ivec2(-1, 0), glm::ivec2(0, 1), glm::ivec2(0, -1) };
+	for (glm::ivec2 offset : offsets)
+	{
+		if (error * 1.5 > GetBandError(pixels, reference.pixels.data(), size, regionMin, regionMax, band, offset))
+			return false;
+	}
+
+	return true;
+}
+
+int main()
+{
+	const TestCase cases[] = {
+		{ "cancel before first tile", CancelBeforeFirstTile },
+		{ "fovea border alignment", FoveaBorderAlignment },
+	};
+
+	int failures = 0;
+	for (const TestCase& testCase : cases)
+	{
+		if (testCase.run())
+			std::cout << "ok   " << testCase.name << std::endl;
+		else
+		{
+			std::cout << "FAIL " << testCase.name << std::endl;
+			failures++;
+		}
+	}
+
+	return failures;
+}
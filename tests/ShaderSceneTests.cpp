@@ -0,0 +1,116 @@
+#include "../common.h"
+#include <algorithm>
+#include "../SceneCodeWriter.h"
+#include "../Scenes.h"
+
+//Compares the shader scenes generated from the entity trees with the snapshots in the given directory (snapshots
+//next to this file by default), "--update" rewrites the snapshots after an intended change to the generated code
+//Needs no GPU, exits with the number of mismatching snapshots
+
+struct SnapshotCase
+{
+	const char* name;
+	SceneLanguage language;
+	bool interactive;
+};
+
+static std::string GenerateCase(const SnapshotCase& snapshotCase)
+{
+	//Shaders read the time uniform, the value never reaches the generated code
+	static const float time = 0.0f;
+
+	SceneArena arena;
+	MaterialTable materials;
+	Entity* scene = snapshotCase.interactive ? CreateInteractiveScene(arena, materials, &time) : CreateRoomScene(arena, materials);
+
+	return GenerateShaderScene(scene, materials, snapshotCase.language);
+}
+
+static bool ReadFile(const std::string& path, std::string& text)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::stringstream stream;
+	stream << file.rdbuf();
+	text = stream.str();
+
+	//A checkout may have turned the line endings into CRLF, the generated code always uses LF
+	text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+	return true;
+}
+
+//Prints the first line that differs, 1 based
+static void PrintDifference(const std::string& expected, const std::string& actual)
+{
+	std::istringstream expectedLines(expected), actualLines(actual);
+	std::string expectedLine, actualLine;
+	for (uint32_t line = 1;; line++)
+	{
+		bool hasExpected = (bool)std::getline(expectedLines, expectedLine);
+		bool hasActual = (bool)std::getline(actualLines, actualLine);
+		if (!hasExpected && !hasActual)
+			return;
+
+		if (hasExpected != hasActual || expectedLine != actualLine)
+		{
+			std::cout << "  line " << line << "\n";
+			std::cout << "  expected: " << (hasExpected ? expectedLine : "<end of file>") << "\n";
+			std::cout << "  actual:   " << (hasActual ? actualLine : "<end of file>") << "\n";
+			return;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "snapshots";
+	bool update = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--update")
+			update = true;
+		else
+			directory = argv[i];
+	}
+
+	const SnapshotCase cases[] = {
+		{ "room.glsl", SceneLanguage::Glsl, false },
+		{ "room.hlsl", SceneLanguage::Hlsl, false },
+		{ "interactive.glsl", SceneLanguage::Glsl, true },
+		{ "interactive.hlsl", SceneLanguage::Hlsl, true },
+	};
+
+	int failures = 0;
+	for (const SnapshotCase& snapshotCase : cases)
+	{
+		std::string path = directory + "/" + snapshotCase.name;
+		std::string actual = GenerateCase(snapshotCase);
+
+		if (update)
+		{
+			std::ofstream file(path, std::ios::binary);
+			file << actual;
+			std::cout << "Updated " << path << std::endl;
+			continue;
+		}
+
+		std::string expected;
+		if (!ReadFile(path, expected))
+		{
+			std::cout << "FAIL " << snapshotCase.name << ": cannot read " << path << std::endl;
+			failures++;
+		}
+		else if (expected != actual)
+		{
+			std::cout << "FAIL " << snapshotCase.name << std::endl;
+			PrintDifference(expected, actual);
+			failures++;
+		}
+		else
+			std::cout << "ok   " << snapshotCase.name << std::endl;
+	}
+
+	return failures;
+}
@@ -0,0 +1,31 @@
+float SDScene(float3 position)
+{
+	float2 v0 = float2(length(float2(position.x, position.z)) - 1.0f, position.y);
+	float v1 = length(v0) - 0.5f;
+	float3 v2 = abs(position - float3(0.0f, -2.5f, 0.0f)) - float3(10.0f, 0.5f, 10.0f);
+	float v3 = length(max(v2, float3(0.0f, 0.0f, 0.0f))) + min(max(v2.x, max(v2.y, v2.z)), 0.0f);
+	float v4 = min(v1, v3);
+	float3 v5 = position - float3(6.0f, 1.0f, 0.0f) * sin(time * 0.5f);
+	float v6 = length(v5) - 0.5f;
+	float v7 = max(2.0f - abs(v4 - v6), 0.0f) * 0.5f;
+	float v8 = min(v4, v6) - v7 * v7 * v7 * 0.333333343f;
+	return v8;
+}
+Surface SDSceneSurface(float3 position)
+{
+	float2 v0 = float2(length(float2(position.x, position.z)) - 1.0f, position.y);
+	float v1 = length(v0) - 0.5f;
+	float3 v2 = abs(position - float3(0.0f, -2.5f, 0.0f)) - float3(10.0f, 0.5f, 10.0f);
+	float v3 = length(max(v2, float3(0.0f, 0.0f, 0.0f))) + min(max(v2.x, max(v2.y, v2.z)), 0.0f);
+	float4 v4 = (v3 < v1) ? float4(0.800000012f, 0.800000012f, 0.800000012f, 0.899999976f) : float4(0.800000012f, 0.600000024f, 0.600000024f, 0.899999976f);
+	float v5 = min(v1, v3);
+	float3 v6 = position - float3(6.0f, 1.0f, 0.0f) * sin(time * 0.5f);
+	float v7 = length(v6) - 0.5f;
+	float v8 = max(2.0f - abs(v5 - v7), 0.0f) * 0.5f;
+	float v9 = min(v5, v7) - v8 * v8 * v8 * 0.333333343f;
+	float4 v10 = (v5 < v7) ? v4 : float4(0.600000024f, 0.600000024f, 0.800000012f, 0.899999976f);
+	Surface surface;
+	surface.distanceToPoint = v9;
+	surface.color = v10.rgb;
+	return surface;
+}
@@ -0,0 +1,60 @@
+float SDScene(float3 position)
+{
+	float v0 = length(position - float3(0.0f, 0.0f, -12.0f)) - 7.0f;
+	float v1 = length(position - float3(-1.5f, 0.0f, 0.0f)) - 1.0f;
+	float v2 = min(v0, v1);
+	float3 v3 = abs(position - float3(20.0f, 0.0f, 0.0f)) - float3(0.00100000005f, 5.0f, 5.0f);
+	float v4 = length(max(v3, float3(0.0f, 0.0f, 0.0f))) + min(max(v3.x, max(v3.y, v3.z)), 0.0f);
+	float3 v5 = abs(position - float3(0.0f, 0.0f, 20.0f)) - float3(5.0f, 5.0f, 0.00100000005f);
+	float v6 = length(max(v5, float3(0.0f, 0.0f, 0.0f))) + min(max(v5.x, max(v5.y, v5.z)), 0.0f);
+	float3 v7 = abs(position - float3(-20.0f, 0.0f, 0.0f)) - float3(0.00100000005f, 5.0f, 5.0f);
+	float v8 = length(max(v7, float3(0.0f, 0.0f, 0.0f))) + min(max(v7.x, max(v7.y, v7.z)), 0.0f);
+	float3 v9 = abs(position - float3(0.0f, 0.0f, -20.0f)) - float3(5.0f, 5.0f, 0.00100000005f);
+	float v10 = length(max(v9, float3(0.0f, 0.0f, 0.0f))) + min(max(v9.x, max(v9.y, v9.z)), 0.0f);
+	float3 v11 = abs(position - float3(0.0f, 20.0f, 0.0f)) - float3(5.0f, 0.00100000005f, 5.0f);
+	float v12 = length(max(v11, float3(0.0f, 0.0f, 0.0f))) + min(max(v11.x, max(v11.y, v11.z)), 0.0f);
+	float3 v13 = abs(position - float3(0.0f, -20.0f, 0.0f)) - float3(5.0f, 0.00100000005f, 5.0f);
+	float v14 = length(max(v13, float3(0.0f, 0.0f, 0.0f))) + min(max(v13.x, max(v13.y, v13.z)), 0.0f);
+	float v15 = min(v4, v6);
+	float v16 = min(v15, v8);
+	float v17 = min(v16, v10);
+	float v18 = min(v17, v12);
+	float v19 = min(v18, v14);
+	float v20 = min(v2, v19);
+	return v20;
+}
+Surface SDSceneSurface(float3 position)
+{
+	float v0 = length(position - float3(0.0f, 0.0f, -12.0f)) - 7.0f;
+	float v1 = length(position - float3(-1.5f, 0.0f, 0.0f)) - 1.0f;
+	float4 v2 = (v1 < v0) ? float4(0.999000013f, 0.899999976f, 0.899999976f, 0.600000024f) : float4(0.899999976f, 0.999000013f, 0.999000013f, 0.899999976f);
+	float v3 = min(v0, v1);
+	float3 v4 = abs(position - float3(20.0f, 0.0f, 0.0f)) - float3(0.00100000005f, 5.0f, 5.0f);
+	float v5 = length(max(v4, float3(0.0f, 0.0f, 0.0f))) + min(max(v4.x, max(v4.y, v4.z)), 0.0f);
+	float3 v6 = abs(position - float3(0.0f, 0.0f, 20.0f)) - float3(5.0f, 5.0f, 0.00100000005f);
+	float v7 = length(max(v6, float3(0.0f, 0.0f, 0.0f))) + min(max(v6.x, max(v6.y, v6.z)), 0.0f);
+	float3 v8 = abs(position - float3(-20.0f, 0.0f, 0.0f)) - float3(0.00100000005f, 5.0f, 5.0f);
+	float v9 = length(max(v8, float3(0.0f, 0.0f, 0.0f))) + min(max(v8.x, max(v8.y, v8.z)), 0.0f);
+	float3 v10 = abs(position - float3(0.0f, 0.0f, -20.0f)) - float3(5.0f, 5.0f, 0.00100000005f);
+	float v11 = length(max(v10, float3(0.0f, 0.0f, 0.0f))) + min(max(v10.x, max(v10.y, v10.z)), 0.0f);
+	float3 v12 = abs(position - float3(0.0f, 20.0f, 0.0f)) - float3(5.0f, 0.00100000005f, 5.0f);
+	float v13 = length(max(v12, float3(0.0f, 0.0f, 0.0f))) + min(max(v12.x, max(v12.y, v12.z)), 0.0f);
+	float3 v14 = abs(position - float3(0.0f, -20.0f, 0.0f)) - float3(5.0f, 0.00100000005f, 5.0f);
+	float v15 = length(max(v14, float3(0.0f, 0.0f, 0.0f))) + min(max(v14.x, max(v14.y, v14.z)), 0.0f);
+	float4 v16 = (v7 < v5) ? float4(0.899999976f, 0.899999976f, 0.999000013f, 0.899999976f) : float4(0.999000013f, 0.899999976f, 0.899999976f, 0.600000024f);
+	float v17 = min(v5, v7);
+	float4 v18 = (v9 < v17) ? float4(0.999000013f, 0.999000013f, 0.899999976f, 0.899999976f) : v16;
+	float v19 = min(v17, v9);
+	float4 v20 = (v11 < v19) ? float4(0.899999976f, 0.999000013f, 0.999000013f, 0.899999976f) : v18;
+	float v21 = min(v19, v11);
+	float4 v22 = (v13 < v21) ? float4(0.999000013f, 0.999000013f, 0.899999976f, 0.899999976f) : v20;
+	float v23 = min(v21, v13);
+	float4 v24 = (v15 < v23) ? float4(0.899999976f, 0.999000013f, 0.999000013f, 0.899999976f) : v22;
+	float v25 = min(v23, v15);
+	float4 v26 = (v25 < v3) ? v24 : v2;
+	float v27 = min(v3, v25);
+	Surface surface;
+	surface.distanceToPoint = v27;
+	surface.color = v26.rgb;
+	return surface;
+}